@@ -29,6 +29,36 @@ void BoardState::Reset()
     key.Recalculate(*this);
 }
 
+bool BoardState::InitialiseFromFen(std::string_view fen)
+{
+    // Split the line into an array of strings seperated by each space
+    std::array<std::string_view, 6> splitFen = {
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR",
+        "w",
+        "-",
+        "-",
+        "0",
+        "1",
+    };
+
+    size_t idx = 0;
+    size_t str_idx = 0;
+
+    while (str_idx < fen.size() && idx < 6)
+    {
+        auto next = fen.find(" ", str_idx);
+        if (next == fen.npos)
+        {
+            next = fen.size();
+        }
+        splitFen[idx] = fen.substr(str_idx, next - str_idx);
+        str_idx = next + 1;
+        idx++;
+    }
+
+    return InitialiseFromFen(splitFen);
+}
+
 bool BoardState::InitialiseFromFen(const std::array<std::string_view, 6>& fen)
 {
     Reset();
@@ -321,7 +351,7 @@ std::ostream& operator<<(std::ostream& os, const BoardState& b)
     return os;
 }
 
-void BoardState::ApplyMove(Move move, Network& net)
+void BoardState::ApplyMove(Move move, InputDelta& delta)
 {
     key.ToggleSTM();
 
@@ -337,8 +367,8 @@ void BoardState::ApplyMove(Move move, Network& net)
     switch (move.GetFlag())
     {
     case QUIET:
-        SetSquareAndUpdate(move.GetTo(), GetSquare(move.GetFrom()), net);
-        ClearSquareAndUpdate(move.GetFrom(), net);
+        SetSquareAndUpdate(move.GetTo(), GetSquare(move.GetFrom()), delta);
+        ClearSquareAndUpdate(move.GetFrom(), delta);
         break;
     case PAWN_DOUBLE_MOVE:
     {
@@ -370,8 +400,8 @@ void BoardState::ApplyMove(Move move, Network& net)
             }
         }
 
-        SetSquareAndUpdate(move.GetTo(), Piece(PAWN, stm), net);
-        ClearSquareAndUpdate(move.GetFrom(), net);
+        SetSquareAndUpdate(move.GetTo(), Piece(PAWN, stm), delta);
+        ClearSquareAndUpdate(move.GetFrom(), delta);
         break;
     }
     case A_SIDE_CASTLE:
@@ -381,10 +411,10 @@ void BoardState::ApplyMove(Move move, Network& net)
         Square rook_start = LSB(old_castle_squares & RankBB[stm == WHITE ? RANK_1 : RANK_8]);
         Square rook_end = stm == WHITE ? SQ_D1 : SQ_D8;
 
-        ClearSquareAndUpdate(king_start, net);
-        ClearSquareAndUpdate(rook_start, net);
-        SetSquareAndUpdate(king_end, Piece(KING, stm), net);
-        SetSquareAndUpdate(rook_end, Piece(ROOK, stm), net);
+        ClearSquareAndUpdate(king_start, delta);
+        ClearSquareAndUpdate(rook_start, delta);
+        SetSquareAndUpdate(king_end, Piece(KING, stm), delta);
+        SetSquareAndUpdate(rook_end, Piece(ROOK, stm), delta);
 
         break;
     }
@@ -395,58 +425,58 @@ void BoardState::ApplyMove(Move move, Network& net)
         Square rook_start = MSB(old_castle_squares & RankBB[stm == WHITE ? RANK_1 : RANK_8]);
         Square rook_end = stm == WHITE ? SQ_F1 : SQ_F8;
 
-        ClearSquareAndUpdate(king_start, net);
-        ClearSquareAndUpdate(rook_start, net);
-        SetSquareAndUpdate(king_end, Piece(KING, stm), net);
-        SetSquareAndUpdate(rook_end, Piece(ROOK, stm), net);
+        ClearSquareAndUpdate(king_start, delta);
+        ClearSquareAndUpdate(rook_start, delta);
+        SetSquareAndUpdate(king_end, Piece(KING, stm), delta);
+        SetSquareAndUpdate(rook_end, Piece(ROOK, stm), delta);
 
         break;
     }
     case CAPTURE:
-        ClearSquareAndUpdate(move.GetTo(), net);
-        SetSquareAndUpdate(move.GetTo(), GetSquare(move.GetFrom()), net);
-        ClearSquareAndUpdate(move.GetFrom(), net);
+        ClearSquareAndUpdate(move.GetTo(), delta);
+        SetSquareAndUpdate(move.GetTo(), GetSquare(move.GetFrom()), delta);
+        ClearSquareAndUpdate(move.GetFrom(), delta);
         break;
     case EN_PASSANT:
-        SetSquareAndUpdate(move.GetTo(), GetSquare(move.GetFrom()), net);
-        ClearSquareAndUpdate(GetPosition(GetFile(move.GetTo()), GetRank(move.GetFrom())), net);
-        ClearSquareAndUpdate(move.GetFrom(), net);
+        SetSquareAndUpdate(move.GetTo(), GetSquare(move.GetFrom()), delta);
+        ClearSquareAndUpdate(GetPosition(GetFile(move.GetTo()), GetRank(move.GetFrom())), delta);
+        ClearSquareAndUpdate(move.GetFrom(), delta);
         break;
     case KNIGHT_PROMOTION:
-        SetSquareAndUpdate(move.GetTo(), Piece(KNIGHT, stm), net);
-        ClearSquareAndUpdate(move.GetFrom(), net);
+        SetSquareAndUpdate(move.GetTo(), Piece(KNIGHT, stm), delta);
+        ClearSquareAndUpdate(move.GetFrom(), delta);
         break;
     case BISHOP_PROMOTION:
-        SetSquareAndUpdate(move.GetTo(), Piece(BISHOP, stm), net);
-        ClearSquareAndUpdate(move.GetFrom(), net);
+        SetSquareAndUpdate(move.GetTo(), Piece(BISHOP, stm), delta);
+        ClearSquareAndUpdate(move.GetFrom(), delta);
         break;
     case ROOK_PROMOTION:
-        SetSquareAndUpdate(move.GetTo(), Piece(ROOK, stm), net);
-        ClearSquareAndUpdate(move.GetFrom(), net);
+        SetSquareAndUpdate(move.GetTo(), Piece(ROOK, stm), delta);
+        ClearSquareAndUpdate(move.GetFrom(), delta);
         break;
     case QUEEN_PROMOTION:
-        SetSquareAndUpdate(move.GetTo(), Piece(QUEEN, stm), net);
-        ClearSquareAndUpdate(move.GetFrom(), net);
+        SetSquareAndUpdate(move.GetTo(), Piece(QUEEN, stm), delta);
+        ClearSquareAndUpdate(move.GetFrom(), delta);
         break;
     case KNIGHT_PROMOTION_CAPTURE:
-        ClearSquareAndUpdate(move.GetTo(), net);
-        SetSquareAndUpdate(move.GetTo(), Piece(KNIGHT, stm), net);
-        ClearSquareAndUpdate(move.GetFrom(), net);
+        ClearSquareAndUpdate(move.GetTo(), delta);
+        SetSquareAndUpdate(move.GetTo(), Piece(KNIGHT, stm), delta);
+        ClearSquareAndUpdate(move.GetFrom(), delta);
         break;
     case BISHOP_PROMOTION_CAPTURE:
-        ClearSquareAndUpdate(move.GetTo(), net);
-        SetSquareAndUpdate(move.GetTo(), Piece(BISHOP, stm), net);
-        ClearSquareAndUpdate(move.GetFrom(), net);
+        ClearSquareAndUpdate(move.GetTo(), delta);
+        SetSquareAndUpdate(move.GetTo(), Piece(BISHOP, stm), delta);
+        ClearSquareAndUpdate(move.GetFrom(), delta);
         break;
     case ROOK_PROMOTION_CAPTURE:
-        ClearSquareAndUpdate(move.GetTo(), net);
-        SetSquareAndUpdate(move.GetTo(), Piece(ROOK, stm), net);
-        ClearSquareAndUpdate(move.GetFrom(), net);
+        ClearSquareAndUpdate(move.GetTo(), delta);
+        SetSquareAndUpdate(move.GetTo(), Piece(ROOK, stm), delta);
+        ClearSquareAndUpdate(move.GetFrom(), delta);
         break;
     case QUEEN_PROMOTION_CAPTURE:
-        ClearSquareAndUpdate(move.GetTo(), net);
-        SetSquareAndUpdate(move.GetTo(), Piece(QUEEN, stm), net);
-        ClearSquareAndUpdate(move.GetFrom(), net);
+        ClearSquareAndUpdate(move.GetTo(), delta);
+        SetSquareAndUpdate(move.GetTo(), Piece(QUEEN, stm), delta);
+        ClearSquareAndUpdate(move.GetFrom(), delta);
         break;
     default:
         assert(0);
@@ -461,7 +491,38 @@ void BoardState::ApplyMove(Move move, Network& net)
     stm = !stm;
 
     assert(key.Verify(*this));
-    assert(net.Verify(*this));
+}
+
+uint64_t BoardState::KeyAfter(Move move) const
+{
+    Zobrist next = key;
+    next.ToggleSTM();
+
+    if (en_passant <= SQ_H8)
+        next.ToggleEnpassant(GetFile(en_passant));
+
+    const Pieces piece = GetSquare(move.GetFrom());
+    next.TogglePieceSquare(piece, move.GetFrom());
+
+    if (move.GetFlag() == EN_PASSANT)
+        next.TogglePieceSquare(Piece(PAWN, !stm), GetPosition(GetFile(move.GetTo()), GetRank(move.GetFrom())));
+    else if (move.IsCapture())
+        next.TogglePieceSquare(GetSquare(move.GetTo()), move.GetTo());
+
+    if (move.IsPromotion())
+        next.TogglePieceSquare(Piece(static_cast<PieceTypes>(KNIGHT + (move.GetFlag() & 3)), stm), move.GetTo());
+    else if (!move.IsCastle())
+        next.TogglePieceSquare(piece, move.GetTo());
+
+    // moving a king, or moving or capturing a rook, loses the matching castling rights
+    uint64_t lost_castle_squares = castle_squares & (SquareBB[move.GetFrom()] | SquareBB[move.GetTo()]);
+    if (GetPieceType(piece) == KING)
+        lost_castle_squares |= castle_squares & RankBB[stm == WHITE ? RANK_1 : RANK_8];
+
+    while (lost_castle_squares)
+        next.ToggleCastle(LSBpop(lost_castle_squares));
+
+    return next.Key();
 }
 
 void BoardState::ApplyNullMove()
@@ -480,17 +541,17 @@ void BoardState::ApplyNullMove()
     assert(key.Verify(*this));
 }
 
-void BoardState::SetSquareAndUpdate(Square square, Pieces piece, Network& net)
+void BoardState::SetSquareAndUpdate(Square square, Pieces piece, InputDelta& delta)
 {
-    net.AddInput(square, piece);
+    delta.adds.push_back({ square, piece });
     key.TogglePieceSquare(piece, square);
     SetSquare(square, piece);
 }
 
-void BoardState::ClearSquareAndUpdate(Square square, Network& net)
+void BoardState::ClearSquareAndUpdate(Square square, InputDelta& delta)
 {
     Pieces piece = GetSquare(square);
-    net.RemoveInput(square, piece);
+    delta.subs.push_back({ square, piece });
     key.TogglePieceSquare(piece, square);
     ClearSquare(square);
 }
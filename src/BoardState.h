@@ -7,7 +7,7 @@
 #include <vector>
 
 class Move;
-class Network;
+struct InputDelta;
 
 /*
 
@@ -74,14 +74,21 @@ public:
 
     uint64_t GetZobristKey() const;
 
+    // A cheap prediction of the zobrist key after the move, so the search can prefetch the child's entries before the
+    // move is applied. Castling moves, and double pawn pushes that create an en passant square, are not predicted
+    // exactly.
+    uint64_t KeyAfter(Move move) const;
+
     void SetSquare(Square square, Pieces piece);
     void ClearSquare(Square square);
 
     void Reset();
     bool InitialiseFromFen(const std::array<std::string_view, 6>& fen);
+    bool InitialiseFromFen(std::string_view fen);
     void UpdateCastleRights(Move move, Zobrist& zobrist_key);
 
-    void ApplyMove(Move move, Network& net);
+    // applies the move, and records the network inputs that changed in delta
+    void ApplyMove(Move move, InputDelta& delta);
     void ApplyNullMove();
 
     // given a from/to square, infer which MoveFlag matches the current position (ignoring promotions)
@@ -90,8 +97,8 @@ public:
     friend std::ostream& operator<<(std::ostream& os, const BoardState& b);
 
 private:
-    void SetSquareAndUpdate(Square square, Pieces piece, Network& net);
-    void ClearSquareAndUpdate(Square square, Network& net);
+    void SetSquareAndUpdate(Square square, Pieces piece, InputDelta& delta);
+    void ClearSquareAndUpdate(Square square, InputDelta& delta);
 
     // optimization: GetWhitePieces/GetBlackPieces can return a precalculated bitboard
     // which is updated only when needed
@@ -1,33 +1,70 @@
 #include "EvalCache.h"
 
+#include <algorithm>
 #include <cstddef>
+#include <limits>
 
-constexpr size_t TableSize = 65536;
+constexpr uint64_t KEY_MASK = 0xFFFFFFFFFFFF;
 
-EvalCacheTable::EvalCacheTable()
+EvalCacheTable::EvalCacheTable(size_t MB)
 {
-    table.resize(TableSize);
+    SetSize(MB);
+}
+
+size_t EvalCacheTable::HashFunction(uint64_t key) const
+{
+    // the high 64 bits of key * size are evenly distributed over [0, size), for any size
+    return (static_cast<unsigned __int128>(key) * table.size()) >> 64;
 }
 
 void EvalCacheTable::AddEntry(uint64_t key, Score eval)
 {
-    table[key % TableSize].key = key;
-    table[key % TableSize].eval = eval;
+    auto& entries = table[HashFunction(key)].entries;
+    auto packed_eval = static_cast<uint16_t>(std::clamp<int>(
+        eval.value(), std::numeric_limits<int16_t>::min(), std::numeric_limits<int16_t>::max()));
+
+    // New entries go to the front of the bucket and push the oldest entry out of the back. If the position is already
+    // in the bucket, only the entries in front of it are moved.
+    size_t end = 0;
+    while (end < entries.size() - 1 && (entries[end].load(std::memory_order_relaxed) >> 16) != (key & KEY_MASK))
+        end++;
+
+    for (size_t i = end; i > 0; i--)
+        entries[i].store(entries[i - 1].load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+    entries[0].store((key << 16) | packed_eval, std::memory_order_relaxed);
 }
 
 bool EvalCacheTable::GetEntry(uint64_t key, Score& eval) const
 {
-    if (table[key % TableSize].key != key)
+    for (const auto& entry : table[HashFunction(key)].entries)
     {
-        return false;
+        uint64_t value = entry.load(std::memory_order_relaxed);
+
+        if ((value >> 16) == (key & KEY_MASK))
+        {
+            eval = static_cast<int16_t>(value & 0xFFFF);
+            return true;
+        }
     }
 
-    eval = table[key % TableSize].eval;
-    return true;
+    return false;
+}
+
+void EvalCacheTable::PreFetch(uint64_t key) const
+{
+    __builtin_prefetch(&table[HashFunction(key)]);
 }
 
 void EvalCacheTable::Reset()
 {
-    table.clear();
-    table.resize(TableSize);
+    for (auto& bucket : table)
+        for (auto& entry : bucket.entries)
+            entry.store(0, std::memory_order_relaxed);
+}
+
+void EvalCacheTable::SetSize(size_t MB)
+{
+    // the buckets are atomic so can't be moved by resize, but a new vector can be moved into place
+    table = std::vector<EvalCacheBucket>(MB * 1024 * 1024 / sizeof(EvalCacheBucket));
 }
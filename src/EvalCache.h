@@ -1,24 +1,38 @@
 #pragma once
 #include "Score.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 
-struct EvalCacheEntry
+// Each entry packs the low 48 bits of the zobrist key with a 16 bit eval, and eight entries fill a cache line. The
+// bucket is picked using the high bits of the key, so the stored bits are independent of the bucket index.
+//
+// The table can be shared between search threads. Each entry is a single word, so a read can never see the key from
+// one write and the eval from another, and relaxed atomics compile to plain loads and stores. Concurrent writes to
+// the same bucket can at worst lose or duplicate an entry.
+struct alignas(64) EvalCacheBucket
 {
-    uint64_t key = 0;
-    Score eval = 0;
+    std::array<std::atomic<uint64_t>, 8> entries = {};
 };
 
 class EvalCacheTable
 {
 public:
-    EvalCacheTable();
+    EvalCacheTable(size_t MB = DEFAULT_SIZE_MB);
 
     void AddEntry(uint64_t key, Score eval);
     bool GetEntry(uint64_t key, Score& eval) const;
+    void PreFetch(uint64_t key) const;
 
     void Reset();
+    void SetSize(size_t MB);
+
+    constexpr static size_t DEFAULT_SIZE_MB = 1;
 
 private:
-    std::vector<EvalCacheEntry> table;
+    size_t HashFunction(uint64_t key) const;
+
+    std::vector<EvalCacheBucket> table;
 };
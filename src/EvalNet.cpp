@@ -10,7 +10,7 @@
 
 void TempoAdjustment(Score& eval);
 
-Score EvaluatePositionNet(const GameState& position, EvalCacheTable& evalTable)
+Score EvaluatePositionNet(GameState& position, EvalCacheTable& evalTable)
 {
     Score eval = 0;
 
@@ -9,4 +9,4 @@ class BoardState;
 class GameState;
 
 bool DeadPosition(const BoardState& board);
-Score EvaluatePositionNet(const GameState& position, EvalCacheTable& evalTable);
+Score EvaluatePositionNet(GameState& position, EvalCacheTable& evalTable);
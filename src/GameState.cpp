@@ -18,9 +18,10 @@ GameState::GameState()
 
 void GameState::ApplyMove(Move move)
 {
-    net.AccumulatorPush();
+    InputDelta delta;
     previousStates.push_back(previousStates.back());
-    MutableBoard().ApplyMove(move, net);
+    MutableBoard().ApplyMove(move, delta);
+    net.AccumulatorPush(delta);
 }
 
 void GameState::ApplyMove(std::string_view strmove)
@@ -83,32 +84,10 @@ bool GameState::InitialiseFromFen(std::array<std::string_view, 6> fen)
 
 bool GameState::InitialiseFromFen(std::string_view fen)
 {
-    // Split the line into an array of strings seperated by each space
-    std::array<std::string_view, 6> splitFen = {
-        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR",
-        "w",
-        "-",
-        "-",
-        "0",
-        "1",
-    };
-
-    size_t idx = 0;
-    size_t str_idx = 0;
-
-    while (str_idx < fen.size() && idx < 6)
-    {
-        auto next = fen.find(" ", str_idx);
-        if (next == fen.npos)
-        {
-            next = fen.size();
-        }
-        splitFen[idx] = fen.substr(str_idx, next - str_idx);
-        str_idx = next + 1;
-        idx++;
-    }
-
-    return InitialiseFromFen(splitFen);
+    Reset();
+    bool ret = MutableBoard().InitialiseFromFen(fen);
+    net.Recalculate(Board());
+    return ret;
 }
 
 void GameState::Reset()
@@ -117,9 +96,15 @@ void GameState::Reset()
     net.Recalculate(Board());
 }
 
-Score GameState::GetEvaluation() const
+void GameState::RecalculateNetwork()
+{
+    net.Recalculate(Board());
+}
+
+Score GameState::GetEvaluation()
 {
-    return net.Eval(Board().stm);
+    assert(net.Verify(Board()));
+    return net.Eval(Board());
 }
 
 bool GameState::CheckForRep(int distanceFromRoot, int maxReps) const
@@ -34,7 +34,11 @@ public:
     // TODO: is this needed?
     void Reset();
 
-    Score GetEvaluation() const;
+    // recalculate the network accumulators from scratch, e.g after new network weights are loaded
+    void RecalculateNetwork();
+
+    // not const, because the network calculates its accumulators lazily
+    Score GetEvaluation();
 
     bool CheckForRep(int distanceFromRoot, int maxReps) const;
 
@@ -38,6 +38,12 @@ public:
     Square GetTo() const;
     MoveFlag GetFlag() const;
 
+    // the packed representation, which can be passed back to Move(uint16_t)
+    constexpr uint16_t GetData() const
+    {
+        return data;
+    }
+
     bool IsPromotion() const;
     bool IsCapture() const;
     bool IsCastle() const;
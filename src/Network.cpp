@@ -3,82 +3,463 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
 
 #include "BitBoardDefine.h"
 #include "BoardState.h"
 #include "incbin/incbin.h"
 
+#if defined(USE_SSE4) || defined(USE_AVX) || defined(USE_AVX2) || defined(USE_AVX512) || defined(USE_AVX512_VNNI)
+#include <immintrin.h>
+#endif
+
 INCBIN(Net, EVALFILE);
 
-alignas(32) std::array<std::array<int16_t, HIDDEN_NEURONS>, INPUT_NEURONS> Network::hiddenWeights = {};
-alignas(32) std::array<int16_t, HIDDEN_NEURONS> Network::hiddenBias = {};
-alignas(32) std::array<int16_t, HIDDEN_NEURONS * 2> Network::outputWeights = {};
-alignas(32) int16_t Network::outputBias = {};
+alignas(64) std::array<std::array<L1Weight, HIDDEN_NEURONS>, INPUT_NEURONS> Network::hiddenWeights = {};
+alignas(64) std::array<int16_t, HIDDEN_NEURONS> Network::hiddenBias = {};
+alignas(64) std::array<int16_t, HIDDEN_NEURONS * 2 * L2_NEURONS> Network::l2Weights = {};
+alignas(64) std::array<int32_t, L2_NEURONS> Network::l2Bias = {};
+OutputLayers Network::outputLayers = {};
 
+// int8 weights use a lower scale, so that weights in the range [-2, 2) can be represented
+#ifdef USE_INT8_L1
+constexpr int16_t L1_SCALE = 64;
+#else
 constexpr int16_t L1_SCALE = 128;
+#endif
 constexpr int16_t L2_SCALE = 128;
 constexpr double SCALE_FACTOR = 1; // Found empirically to maximize elo
 
-template <typename T, size_t SIZE>
-[[nodiscard]] std::array<T, SIZE> ReLU(const std::array<T, SIZE>& source)
+// Koi nets have an 8 byte header, followed by the float weights and biases of each layer
+constexpr size_t NET_HEADER_SIZE = 8;
+constexpr size_t NET_FILE_SIZE = NET_HEADER_SIZE
+    + sizeof(float)
+        * (INPUT_NEURONS * HIDDEN_NEURONS + HIDDEN_NEURONS + HIDDEN_NEURONS * 2 * L2_NEURONS + L2_NEURONS
+            + OutputLayers::PARAMETERS);
+
+// The native builds only define the highest supported instruction set, so each SIMD path also needs to check for the
+// instruction sets above it
+#if defined(USE_AVX512) || defined(USE_AVX512_VNNI)
+using vec_int16 = __m512i;
+constexpr size_t VEC_INT16_WIDTH = 32;
+#define vec_load _mm512_load_si512
+#define vec_store _mm512_store_si512
+#define vec_add_epi16 _mm512_add_epi16
+#define vec_sub_epi16 _mm512_sub_epi16
+#define vec_max_epi16 _mm512_max_epi16
+#define vec_madd_epi16 _mm512_madd_epi16
+#define vec_add_epi32 _mm512_add_epi32
+#define vec_zero _mm512_setzero_si512
+#define vec_set1_epi32 _mm512_set1_epi32
+#define vec_reduce_add_epi32 _mm512_reduce_add_epi32
+#elif defined(USE_AVX2)
+using vec_int16 = __m256i;
+constexpr size_t VEC_INT16_WIDTH = 16;
+#define vec_load(a) _mm256_load_si256(reinterpret_cast<const __m256i*>(a))
+#define vec_store(a, b) _mm256_store_si256(reinterpret_cast<__m256i*>(a), b)
+#define vec_add_epi16 _mm256_add_epi16
+#define vec_sub_epi16 _mm256_sub_epi16
+#define vec_max_epi16 _mm256_max_epi16
+#define vec_madd_epi16 _mm256_madd_epi16
+#define vec_add_epi32 _mm256_add_epi32
+#define vec_zero _mm256_setzero_si256
+#define vec_set1_epi32 _mm256_set1_epi32
+inline int32_t vec_reduce_add_epi32(__m256i v)
+{
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+}
+#elif defined(USE_SSE4) || defined(USE_AVX)
+using vec_int16 = __m128i;
+constexpr size_t VEC_INT16_WIDTH = 8;
+#define vec_load(a) _mm_load_si128(reinterpret_cast<const __m128i*>(a))
+#define vec_store(a, b) _mm_store_si128(reinterpret_cast<__m128i*>(a), b)
+#define vec_add_epi16 _mm_add_epi16
+#define vec_sub_epi16 _mm_sub_epi16
+#define vec_max_epi16 _mm_max_epi16
+#define vec_madd_epi16 _mm_madd_epi16
+#define vec_add_epi32 _mm_add_epi32
+#define vec_zero _mm_setzero_si128
+#define vec_set1_epi32 _mm_set1_epi32
+inline int32_t vec_reduce_add_epi32(__m128i v)
 {
-    std::array<T, SIZE> ret;
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+#endif
 
-    for (size_t i = 0; i < SIZE; i++)
-        ret[i] = std::max(T(0), source[i]);
+#ifdef VEC_INT16_WIDTH
+// load VEC_INT16_WIDTH first layer weights, widening them to int16 if required
+inline vec_int16 vec_load_l1_weights(const L1Weight* weights)
+{
+#if !defined(USE_INT8_L1)
+    return vec_load(weights);
+#elif defined(USE_AVX512) || defined(USE_AVX512_VNNI)
+    return _mm512_cvtepi8_epi16(_mm256_load_si256(reinterpret_cast<const __m256i*>(weights)));
+#elif defined(USE_AVX2)
+    return _mm256_cvtepi8_epi16(_mm_load_si128(reinterpret_cast<const __m128i*>(weights)));
+#else
+    return _mm_cvtepi8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(weights)));
+#endif
+}
 
-    return ret;
+// acc += a[0] * b[0] + a[1] * b[1] for each pair of int16 lanes, as a single instruction with VNNI
+inline vec_int16 vec_dpwssd_epi32(vec_int16 acc, vec_int16 a, vec_int16 b)
+{
+#if defined(USE_AVX512_VNNI)
+    return _mm512_dpwssd_epi32(acc, a, b);
+#else
+    return vec_add_epi32(acc, vec_madd_epi16(a, b));
+#endif
 }
+#endif
+
+#ifdef VEC_INT16_WIDTH
+// We keep a tile of the accumulator in registers while applying every feature row to it, so each part of the
+// accumulator is only loaded and stored once per update. 16 registers leaves room for the weight loads on all targets.
+constexpr size_t TILE_REGISTERS = 16;
+constexpr size_t TILE_WIDTH = TILE_REGISTERS * VEC_INT16_WIDTH;
+static_assert(HIDDEN_NEURONS % TILE_WIDTH == 0);
+#endif
+
+// dst = src + sum(weights[adds]) - sum(weights[subs]). src and dst may alias.
+void ApplyRows(const int16_t* src, int16_t* dst, const std::array<L1Weight, HIDDEN_NEURONS>* weights,
+    const size_t* adds, size_t add_count, const size_t* subs, size_t sub_count)
+{
+#ifdef VEC_INT16_WIDTH
+    for (size_t tile = 0; tile < HIDDEN_NEURONS; tile += TILE_WIDTH)
+    {
+        vec_int16 regs[TILE_REGISTERS];
+
+        for (size_t i = 0; i < TILE_REGISTERS; i++)
+            regs[i] = vec_load(&src[tile + i * VEC_INT16_WIDTH]);
+
+        for (size_t a = 0; a < add_count; a++)
+        {
+            const L1Weight* row = &weights[adds[a]][tile];
+            for (size_t i = 0; i < TILE_REGISTERS; i++)
+                regs[i] = vec_add_epi16(regs[i], vec_load_l1_weights(&row[i * VEC_INT16_WIDTH]));
+        }
+
+        for (size_t s = 0; s < sub_count; s++)
+        {
+            const L1Weight* row = &weights[subs[s]][tile];
+            for (size_t i = 0; i < TILE_REGISTERS; i++)
+                regs[i] = vec_sub_epi16(regs[i], vec_load_l1_weights(&row[i * VEC_INT16_WIDTH]));
+        }
 
-template <typename T_out, typename T_in, size_t SIZE>
-void DotProductHalves(const std::array<T_in, SIZE>& stm, const std::array<T_in, SIZE>& other,
-    const std::array<T_in, SIZE * 2>& weights, T_out& output)
+        for (size_t i = 0; i < TILE_REGISTERS; i++)
+            vec_store(&dst[tile + i * VEC_INT16_WIDTH], regs[i]);
+    }
+#else
+    if (src != dst)
+        std::memcpy(dst, src, HIDDEN_NEURONS * sizeof(int16_t));
+
+    for (size_t a = 0; a < add_count; a++)
+        for (size_t j = 0; j < HIDDEN_NEURONS; j++)
+            dst[j] += weights[adds[a]][j];
+
+    for (size_t s = 0; s < sub_count; s++)
+        for (size_t j = 0; j < HIDDEN_NEURONS; j++)
+            dst[j] -= weights[subs[s]][j];
+#endif
+}
+
+// sum(ReLU(stm[i]) * weights[i]) + sum(ReLU(other[i]) * weights[i + HIDDEN_NEURONS]), read straight from the
+// accumulator. The activations are non-negative int16, so each pair of products fits in an int32 lane.
+int32_t ReLUDotProduct(const int16_t* stm, const int16_t* other, const int16_t* weights)
 {
-    for (size_t i = 0; i < SIZE; i++)
+#ifdef VEC_INT16_WIDTH
+    // independent sums to hide the latency of the multiply-add
+    constexpr size_t SUMS = 4;
+    static_assert(HIDDEN_NEURONS % (SUMS * VEC_INT16_WIDTH) == 0);
+
+    const vec_int16 zero = vec_zero();
+    vec_int16 sums[SUMS];
+
+    for (size_t i = 0; i < SUMS; i++)
+        sums[i] = vec_zero();
+
+    for (const int16_t* half : { stm, other })
     {
-        output += stm[i] * weights[i];
+        for (size_t i = 0; i < HIDDEN_NEURONS; i += SUMS * VEC_INT16_WIDTH)
+        {
+            for (size_t j = 0; j < SUMS; j++)
+            {
+                vec_int16 activation = vec_max_epi16(vec_load(&half[i + j * VEC_INT16_WIDTH]), zero);
+                sums[j] = vec_dpwssd_epi32(sums[j], activation, vec_load(&weights[i + j * VEC_INT16_WIDTH]));
+            }
+        }
+
+        weights += HIDDEN_NEURONS;
     }
 
-    for (size_t i = 0; i < SIZE; i++)
+    for (size_t i = 1; i < SUMS; i++)
+        sums[0] = vec_add_epi32(sums[0], sums[i]);
+
+    return vec_reduce_add_epi32(sums[0]);
+#else
+    int32_t output = 0;
+
+    for (size_t i = 0; i < HIDDEN_NEURONS; i++)
+        output += std::max<int16_t>(0, stm[i]) * weights[i];
+
+    for (size_t i = 0; i < HIDDEN_NEURONS; i++)
+        output += std::max<int16_t>(0, other[i]) * weights[i + HIDDEN_NEURONS];
+
+    return output;
+#endif
+}
+
+// output += sum(ReLU(input[i]) * weights[i]) over one half of the accumulator. The weights are stored
+// [input / 2][output][input % 2], so each pair of inputs is one multiply-add per register of outputs, like
+// ReLUDotProduct. Most activations are zero after the ReLU, so pairs that are both zero are skipped, which is much
+// cheaper than a dense product when there is more than one output.
+template <size_t Out>
+void SparseReLUAffine(const int16_t* input, const int16_t* weights, int32_t* output)
+{
+    static_assert(HIDDEN_NEURONS % 2 == 0);
+
+#ifdef VEC_INT16_WIDTH
+    constexpr size_t VEC_INT32_WIDTH = VEC_INT16_WIDTH / 2;
+
+    if constexpr (Out % VEC_INT32_WIDTH == 0)
     {
-        output += other[i] * weights[i + SIZE];
+        constexpr size_t REGISTERS = Out / VEC_INT32_WIDTH;
+        vec_int16 sums[REGISTERS];
+
+        for (size_t j = 0; j < REGISTERS; j++)
+            sums[j] = vec_load(&output[j * VEC_INT32_WIDTH]);
+
+        for (size_t i = 0; i < HIDDEN_NEURONS; i += 2)
+        {
+            const auto first = static_cast<uint16_t>(std::max<int16_t>(0, input[i]));
+            const auto second = static_cast<uint16_t>(std::max<int16_t>(0, input[i + 1]));
+            const uint32_t pair = first | second << 16;
+
+            if (pair == 0)
+                continue;
+
+            const vec_int16 activations = vec_set1_epi32(static_cast<int32_t>(pair));
+            const int16_t* row = &weights[i * Out];
+            for (size_t j = 0; j < REGISTERS; j++)
+                sums[j] = vec_dpwssd_epi32(sums[j], activations, vec_load(&row[j * VEC_INT16_WIDTH]));
+        }
+
+        for (size_t j = 0; j < REGISTERS; j++)
+            vec_store(&output[j * VEC_INT32_WIDTH], sums[j]);
+
+        return;
+    }
+#endif
+
+    for (size_t i = 0; i < HIDDEN_NEURONS; i += 2)
+    {
+        const int16_t first = std::max<int16_t>(0, input[i]);
+        const int16_t second = std::max<int16_t>(0, input[i + 1]);
+
+        if (first == 0 && second == 0)
+            continue;
+
+        const int16_t* row = &weights[i * Out];
+        for (size_t j = 0; j < Out; j++)
+            output[j] += first * row[j * 2] + second * row[j * 2 + 1];
     }
 }
 
 void Network::Init()
 {
-    // Koi nets must skip 8 bytes
-    auto Data = reinterpret_cast<const float*>(gNetData + 8);
+    assert(gNetSize == NET_FILE_SIZE);
+    LoadWeights(gNetData);
+}
+
+void Network::LoadWeights(const unsigned char* net_data)
+{
+    auto Data = reinterpret_cast<const float*>(net_data + NET_HEADER_SIZE);
+
+    // a weight outside the range of L1Weight is clamped, which changes the evaluation, so warn when that happens
+    constexpr double l1_min = std::numeric_limits<L1Weight>::min();
+    constexpr double l1_max = std::numeric_limits<L1Weight>::max();
+    size_t clamped = 0;
 
     for (size_t i = 0; i < INPUT_NEURONS; i++)
+    {
         for (size_t j = 0; j < HIDDEN_NEURONS; j++)
-            hiddenWeights[i][j] = (int16_t)round(*Data++ * L1_SCALE);
+        {
+            const double weight = round(*Data++ * L1_SCALE);
+            clamped += weight < l1_min || weight > l1_max;
+            hiddenWeights[i][j] = (L1Weight)std::clamp(weight, l1_min, l1_max);
+        }
+    }
+
+    if (clamped > 0)
+        std::cout << "info string warning " << clamped << " first layer weights were clamped to fit in "
+                  << sizeof(L1Weight) * 8 << " bits" << std::endl;
 
     for (size_t i = 0; i < HIDDEN_NEURONS; i++)
         hiddenBias[i] = (int16_t)round(*Data++ * L1_SCALE);
 
-    for (size_t i = 0; i < HIDDEN_NEURONS * 2; i++)
-        outputWeights[i] = (int16_t)round(*Data++ * SCALE_FACTOR * L2_SCALE);
+    // stored [output][input] in the file, and [input / 2][output][input % 2] here for SparseReLUAffine. With a single
+    // output this is the same as [input], which ReLUDotProduct reads.
+    for (size_t i = 0; i < L2_NEURONS; i++)
+        for (size_t j = 0; j < HIDDEN_NEURONS * 2; j++)
+            l2Weights[(j / 2 * L2_NEURONS + i) * 2 + j % 2] = (int16_t)round(*Data++ * SCALE_FACTOR * L2_SCALE);
+
+    // the bias is added to the product of the L1_SCALE activations and L2_SCALE weights
+    for (size_t i = 0; i < L2_NEURONS; i++)
+        l2Bias[i] = (int16_t)round(*Data++ * SCALE_FACTOR * L2_SCALE) * L1_SCALE;
+
+    outputLayers.Load(Data);
 
-    outputBias = (int16_t)round(*Data++ * SCALE_FACTOR * L2_SCALE);
+    assert(reinterpret_cast<const unsigned char*>(Data) == net_data + NET_FILE_SIZE);
+}
+
+bool Network::LoadFile(const std::string& path)
+{
+    // The weights are quantized from the floats in the file into private arrays, so mapping the file wouldn't let
+    // processes share them. It is read into a temporary buffer instead.
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file || static_cast<size_t>(file.tellg()) != NET_FILE_SIZE)
+    {
+        std::cout << "info string unable to open network file " << path << " of the expected size of "
+                  << NET_FILE_SIZE << " bytes" << std::endl;
+        return false;
+    }
+
+    std::vector<unsigned char> buffer(NET_FILE_SIZE);
+    file.seekg(0);
+    if (!file.read(reinterpret_cast<char*>(buffer.data()), NET_FILE_SIZE))
+    {
+        std::cout << "info string unable to read network file " << path << std::endl;
+        return false;
+    }
 
-    assert(reinterpret_cast<const unsigned char*>(Data) == gNetData + gNetSize);
+    LoadWeights(buffer.data());
+
+    std::cout << "info string loaded network file " << path << std::endl;
+    return true;
+}
+
+Network::Network()
+    : AccumulatorStack(new AccumulatorEntry[ACCUMULATOR_STACK_CAPACITY])
+    , AccumulatorTop(&AccumulatorStack[0])
+{
+    ResetRefreshCache();
+}
+
+Network::Network(const Network& other)
+    : Network()
+{
+    *this = other;
+}
+
+Network& Network::operator=(const Network& other)
+{
+    if (this == &other)
+        return *this;
+
+    // only the live part of the stack needs to be copied
+    size_t size = other.AccumulatorTop - &other.AccumulatorStack[0] + 1;
+    std::copy(&other.AccumulatorStack[0], &other.AccumulatorStack[0] + size, &AccumulatorStack[0]);
+    AccumulatorTop = &AccumulatorStack[size - 1];
+    RefreshCache = other.RefreshCache;
+    return *this;
 }
 
 void Network::Recalculate(const BoardState& board)
 {
-    AccumulatorStack = { { hiddenBias, hiddenBias } };
+    // the weights might have changed since the cache was last used
+    ResetRefreshCache();
+
+    AccumulatorTop = &AccumulatorStack[0];
+
+    for (Players view : { WHITE, BLACK })
+    {
+        AccumulatorTop->king_state[view] = king_state(board, view);
+        RefreshFromCache(board, view, AccumulatorTop->acc.side[view]);
+        AccumulatorTop->computed[view] = true;
+    }
+}
+
+void Network::ResetRefreshCache()
+{
+    // an empty board is correctly represented by the bias alone
+    for (auto& view_cache : RefreshCache)
+    {
+        for (auto& entry : view_cache)
+        {
+            entry.acc = hiddenBias;
+            entry.board = {};
+        }
+    }
+}
+
+void Network::RefreshFromCache(const BoardState& board, Players view, std::array<int16_t, HIDDEN_NEURONS>& acc)
+{
+    const size_t state = king_state(board, view);
+    auto& entry = RefreshCache[view][state];
+
+    // a piece can only be added or removed from each square once, so there are at most 32 of each
+    std::array<size_t, 32> adds;
+    std::array<size_t, 32> subs;
+    size_t add_count = 0;
+    size_t sub_count = 0;
 
     for (int i = 0; i < N_PIECES; i++)
     {
         Pieces piece = static_cast<Pieces>(i);
-        uint64_t bb = board.GetPieceBB(piece);
+        uint64_t added = board.GetPieceBB(piece) & ~entry.board[piece];
+        uint64_t removed = entry.board[piece] & ~board.GetPieceBB(piece);
+
+        while (added)
+        {
+            assert(add_count < adds.size());
+            adds[add_count++] = index(LSBpop(added), piece, view, state);
+        }
+
+        while (removed)
+        {
+            assert(sub_count < subs.size());
+            subs[sub_count++] = index(LSBpop(removed), piece, view, state);
+        }
 
-        while (bb)
+        entry.board[piece] = board.GetPieceBB(piece);
+    }
+
+    ApplyRows(entry.acc.data(), entry.acc.data(), hiddenWeights.data(), adds.data(), add_count, subs.data(), sub_count);
+    acc = entry.acc;
+}
+
+void Network::Refresh(const BoardState& board, HalfAccumulator& acc)
+{
+    for (Players view : { WHITE, BLACK })
+    {
+        const size_t state = king_state(board, view);
+
+        // at most 32 pieces can be on the board
+        std::array<size_t, 32> indices;
+        size_t count = 0;
+
+        for (int i = 0; i < N_PIECES; i++)
         {
-            Square sq = LSBpop(bb);
-            AddInput(sq, piece);
+            Pieces piece = static_cast<Pieces>(i);
+            uint64_t bb = board.GetPieceBB(piece);
+
+            while (bb)
+            {
+                assert(count < indices.size());
+                indices[count++] = index(LSBpop(bb), piece, view, state);
+            }
         }
+
+        ApplyRows(hiddenBias.data(), acc.side[view].data(), hiddenWeights.data(), indices.data(), count, nullptr, 0);
     }
 }
 
@@ -87,80 +468,188 @@ Square MirrorVertically(Square sq)
     return static_cast<Square>(sq ^ 56);
 }
 
-int Network::index(Square square, Pieces piece, Players view)
+Square MirrorHorizontally(Square sq)
+{
+    return static_cast<Square>(sq ^ 7);
+}
+
+size_t Network::king_state(Square king, Players view)
+{
+    Square sq = view == WHITE ? king : MirrorVertically(king);
+
+    if constexpr (KING_MIRRORING)
+        return KING_BUCKETS[sq] * 2 + (GetFile(sq) >= FILE_E);
+    else
+        return KING_BUCKETS[sq];
+}
+
+size_t Network::king_state(const BoardState& board, Players view)
+{
+    // a board without a king only happens while the position is being reset
+    uint64_t king = board.GetPieceBB(KING, view);
+    return king ? king_state(LSB(king), view) : 0;
+}
+
+int Network::index(Square square, Pieces piece, Players view, size_t king_state)
 {
     Square sq = view == WHITE ? square : MirrorVertically(square);
     Pieces relativeColor = static_cast<Pieces>(view == ColourOfPiece(piece));
     PieceTypes pieceType = GetPieceType(piece);
+    size_t bucket = king_state;
+
+    if constexpr (KING_MIRRORING)
+    {
+        if (king_state % 2)
+            sq = MirrorHorizontally(sq);
 
-    return sq + pieceType * 64 + relativeColor * 64 * 6;
+        bucket = king_state / 2;
+    }
+
+    return sq + pieceType * 64 + relativeColor * 64 * 6 + bucket * 64 * 12;
 }
 
-bool Network::Verify(const BoardState& board) const
+bool Network::Verify(const BoardState& board)
 {
-    HalfAccumulator correct_answer = { hiddenBias, hiddenBias };
+    HalfAccumulator correct_answer;
+    Refresh(board, correct_answer);
+    return correct_answer == Materialize(board);
+}
 
-    for (int i = 0; i < N_PIECES; i++)
+void Network::AccumulatorPush(const InputDelta& delta)
+{
+    assert(AccumulatorTop < &AccumulatorStack[ACCUMULATOR_STACK_CAPACITY - 1]);
+    AccumulatorTop++;
+    AccumulatorTop->delta = delta;
+    AccumulatorTop->king_state = (AccumulatorTop - 1)->king_state;
+    AccumulatorTop->computed = { false, false };
+
+    // if a king moved, the king state might have changed
+    for (const auto& add : delta.adds)
     {
-        Pieces piece = static_cast<Pieces>(i);
-        uint64_t bb = board.GetPieceBB(piece);
+        if (GetPieceType(add.piece) == KING)
+        {
+            Players view = ColourOfPiece(add.piece);
+            AccumulatorTop->king_state[view] = king_state(add.square, view);
+        }
+    }
+}
+
+const HalfAccumulator& Network::Materialize(const BoardState& board)
+{
+    for (Players view : { WHITE, BLACK })
+    {
+        // Walk back to the nearest computed accumulator. If the king state changes along the way, the deltas can't be
+        // applied and we refresh instead.
+        AccumulatorEntry* entry = AccumulatorTop;
+        while (!entry->computed[view] && entry->king_state[view] == (entry - 1)->king_state[view])
+            entry--;
 
-        while (bb)
+        if (!entry->computed[view])
         {
-            Square sq = LSBpop(bb);
-            size_t white_index = index(sq, piece, WHITE);
-            size_t black_index = index(sq, piece, BLACK);
+            RefreshFromCache(board, view, AccumulatorTop->acc.side[view]);
+            AccumulatorTop->computed[view] = true;
+            continue;
+        }
 
-            for (size_t j = 0; j < HIDDEN_NEURONS; j++)
-            {
-                correct_answer.side[WHITE][j] += hiddenWeights[white_index][j];
-                correct_answer.side[BLACK][j] += hiddenWeights[black_index][j];
-            }
+        for (entry++; entry <= AccumulatorTop; entry++)
+        {
+            const size_t state = entry->king_state[view];
+            std::array<size_t, 2> adds;
+            std::array<size_t, 2> subs;
+
+            for (size_t j = 0; j < entry->delta.adds.size(); j++)
+                adds[j] = index(entry->delta.adds[j].square, entry->delta.adds[j].piece, view, state);
+
+            for (size_t j = 0; j < entry->delta.subs.size(); j++)
+                subs[j] = index(entry->delta.subs[j].square, entry->delta.subs[j].piece, view, state);
+
+            ApplyRows((entry - 1)->acc.side[view].data(), entry->acc.side[view].data(), hiddenWeights.data(),
+                adds.data(), entry->delta.adds.size(), subs.data(), entry->delta.subs.size());
+            entry->computed[view] = true;
         }
     }
 
-    return correct_answer == AccumulatorStack.back();
+    return AccumulatorTop->acc;
 }
 
-void Network::AccumulatorPush()
+void Network::PrefetchRows(const BoardState& board, Move move)
 {
-    AccumulatorStack.push_back(AccumulatorStack.back());
+    const Pieces piece = board.GetSquare(move.GetFrom());
+    const Pieces captured = move.IsCapture() && move.GetFlag() != EN_PASSANT ? board.GetSquare(move.GetTo()) : N_PIECES;
+
+    auto prefetch_row = [](size_t row)
+    {
+        const char* begin = reinterpret_cast<const char*>(hiddenWeights[row].data());
+        for (size_t i = 0; i < sizeof(hiddenWeights[row]); i += 64)
+            __builtin_prefetch(begin + i);
+    };
+
+    for (Players view : { WHITE, BLACK })
+    {
+        // king moves that change the king state cause a refresh rather than an incremental update
+        const size_t state = king_state(board, view);
+        prefetch_row(index(move.GetFrom(), piece, view, state));
+        prefetch_row(index(move.GetTo(), piece, view, state));
+
+        if (captured != N_PIECES)
+            prefetch_row(index(move.GetTo(), captured, view, state));
+    }
 }
 
 void Network::AccumulatorPop()
 {
-    AccumulatorStack.pop_back();
+    assert(AccumulatorTop > &AccumulatorStack[0]);
+    AccumulatorTop--;
 }
 
-void Network::AddInput(Square square, Pieces piece)
+Score Network::Output(const HalfAccumulator& acc, Players stm)
 {
-    size_t white_index = index(square, piece, WHITE);
-    size_t black_index = index(square, piece, BLACK);
-
-    for (size_t j = 0; j < HIDDEN_NEURONS; j++)
+    if constexpr (L2_NEURONS == 1)
     {
-        AccumulatorStack.back().side[WHITE][j] += hiddenWeights[white_index][j];
-        AccumulatorStack.back().side[BLACK][j] += hiddenWeights[black_index][j];
+        int32_t output = l2Bias[0];
+        output += ReLUDotProduct(acc.side[stm].data(), acc.side[!stm].data(), l2Weights.data());
+        output /= L1_SCALE * L2_SCALE;
+        return output;
     }
+    else
+    {
+        alignas(64) std::array<int32_t, L2_NEURONS> l2 = l2Bias;
+        SparseReLUAffine<L2_NEURONS>(acc.side[stm].data(), l2Weights.data(), l2.data());
+        SparseReLUAffine<L2_NEURONS>(acc.side[!stm].data(), &l2Weights[HIDDEN_NEURONS * L2_NEURONS], l2.data());
+
+        // the remaining layers are calculated in float, which is cheap at these sizes and avoids requantizing
+        alignas(64) std::array<float, L2_NEURONS> activations;
+        for (size_t i = 0; i < L2_NEURONS; i++)
+            activations[i] = std::max(l2[i], 0) / (L1_SCALE * L2_SCALE * SCALE_FACTOR);
+
+        return static_cast<int>(std::round(outputLayers.Forward(activations.data()) * SCALE_FACTOR));
+    }
+}
+
+Score Network::Eval(const BoardState& board)
+{
+    return Output(Materialize(board), board.stm);
 }
 
-void Network::RemoveInput(Square square, Pieces piece)
+std::vector<Score> Network::EvalBatch(const std::vector<BoardState>& boards)
 {
-    size_t white_index = index(square, piece, WHITE);
-    size_t black_index = index(square, piece, BLACK);
+    std::vector<Score> scores;
+    scores.reserve(boards.size());
 
-    for (size_t j = 0; j < HIDDEN_NEURONS; j++)
+    // Each accumulator is built from the last one calculated for the same king state through a refresh cache, like
+    // the search does, so only the pieces that differ between the two boards are applied. Positions from the same game
+    // or opening share most of their pieces, and even unrelated positions share some. The temporary network keeps
+    // the cache separate from every search thread's network.
+    Network network;
+    HalfAccumulator acc;
+
+    for (const auto& board : boards)
     {
-        AccumulatorStack.back().side[WHITE][j] -= hiddenWeights[white_index][j];
-        AccumulatorStack.back().side[BLACK][j] -= hiddenWeights[black_index][j];
+        for (Players view : { WHITE, BLACK })
+            network.RefreshFromCache(board, view, acc.side[view]);
+
+        scores.push_back(Output(acc, board.stm));
     }
-}
 
-Score Network::Eval(Players stm) const
-{
-    int32_t output = outputBias * L1_SCALE;
-    DotProductHalves(
-        ReLU(AccumulatorStack.back().side[stm]), ReLU(AccumulatorStack.back().side[!stm]), outputWeights, output);
-    output /= L1_SCALE * L2_SCALE;
-    return output;
+    return scores;
 }
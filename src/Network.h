@@ -2,19 +2,63 @@
 #include <array>
 #include <cstdint>
 #include <cstring>
+#include <memory>
+#include <string>
 #include <vector>
 
 #include "BitBoardDefine.h"
+#include "Move.h"
+#include "NetworkLayers.h"
 #include "Score.h"
+#include "StaticVector.h"
 
-constexpr size_t INPUT_NEURONS = 12 * 64;
+// Inputs are relative to each player's own king. The king square (from that player's perspective) selects one of
+// KING_BUCKET_COUNT sets of 768 piece-square inputs, and with KING_MIRRORING the board is also mirrored horizontally
+// whenever the king is on the E-H files. The current network uses a single bucket without mirroring.
+constexpr bool KING_MIRRORING = false;
+constexpr size_t KING_BUCKET_COUNT = 1;
+
+// clang-format off
+constexpr std::array<uint8_t, N_SQUARES> KING_BUCKETS = {
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+};
+// clang-format on
+
+// Each bucket, and each side of the board when mirroring, is a separate 'king state'. Moving the king between states
+// changes every input for that player, and requires the accumulator to be refreshed.
+constexpr size_t KING_STATES = KING_BUCKET_COUNT * (KING_MIRRORING ? 2 : 1);
+
+constexpr size_t INPUT_NEURONS = 12 * 64 * KING_BUCKET_COUNT;
 constexpr size_t HIDDEN_NEURONS = 512;
 
+// The first dense layer takes the ReLU of both accumulator perspectives and has L2_NEURONS outputs, which then pass
+// through the float layers in OutputLayers to give a single output. The current network feeds the accumulator straight
+// into the output. A deeper network would use e.g L2_NEURONS = 16 and OutputLayers = DenseStack<16, 32, 1>.
+constexpr size_t L2_NEURONS = 1;
+using OutputLayers = DenseStack<L2_NEURONS>;
+static_assert(OutputLayers::OUTPUTS == 1);
+
+// Building with USE_INT8_L1 stores the input -> hidden weights as int8 rather than int16. This halves the size of the
+// largest weight matrix so that it can stay resident in L2, at the cost of quantizing the weights more coarsely. The
+// accumulators remain int16. Loading a network prints a warning if any weight was out of range and had to be clamped.
+#ifdef USE_INT8_L1
+using L1Weight = int8_t;
+#else
+using L1Weight = int16_t;
+#endif
+
 class BoardState;
 
 struct HalfAccumulator
 {
-    alignas(32) std::array<std::array<int16_t, HIDDEN_NEURONS>, N_PLAYERS> side;
+    alignas(64) std::array<std::array<int16_t, HIDDEN_NEURONS>, N_PLAYERS> side;
 
     bool operator==(const HalfAccumulator& rhs) const
     {
@@ -22,35 +66,109 @@ struct HalfAccumulator
     }
 };
 
+// The inputs changed by a single move. Castling moves two pieces, and captures remove two pieces and add one
+struct InputDelta
+{
+    struct Input
+    {
+        Square square;
+        Pieces piece;
+    };
+
+    StaticVector<Input, 2> adds;
+    StaticVector<Input, 2> subs;
+};
+
+// Accumulators are calculated lazily, because many positions in the search are never evaluated. Each entry stores the
+// delta from the previous position, and the accumulator is only calculated once it is needed.
+struct AccumulatorEntry
+{
+    HalfAccumulator acc;
+    InputDelta delta;
+    std::array<uint8_t, N_PLAYERS> king_state;
+    std::array<bool, N_PLAYERS> computed = {};
+};
+
+// Refreshing an accumulator is done by taking the last accumulator we calculated for the same player and king state,
+// and applying the difference between the board it was calculated for and the current board. This is usually a small
+// number of pieces, and is much cheaper than building the accumulator from scratch.
+struct RefreshCacheEntry
+{
+    alignas(64) std::array<int16_t, HIDDEN_NEURONS> acc;
+    std::array<uint64_t, N_PIECES> board;
+};
+
 class Network
 {
 public:
+    Network();
+    Network(const Network& other);
+    Network& operator=(const Network& other);
+
     void Recalculate(const BoardState& board);
 
     // return true if the incrementally updated accumulators are correct
-    bool Verify(const BoardState& board) const;
+    bool Verify(const BoardState& board);
 
     // calculates starting from the first hidden layer and skips input -> hidden
-    Score Eval(Players stm) const;
+    Score Eval(const BoardState& board);
 
-    // call and then update inputs as required
-    void AccumulatorPush();
+    // evaluate many positions, building each accumulator incrementally from an earlier one with a private refresh
+    // cache, without touching the accumulators of any network
+    static std::vector<Score> EvalBatch(const std::vector<BoardState>& boards);
 
-    void AddInput(Square square, Pieces piece);
-    void RemoveInput(Square square, Pieces piece);
+    // push a new accumulator, which will be calculated from the previous one with the delta applied when needed
+    void AccumulatorPush(const InputDelta& delta);
 
     // do undo the last move
     void AccumulatorPop();
 
+    // prefetch the weight rows that applying the move to the board will add to or remove from the accumulators
+    static void PrefetchRows(const BoardState& board, Move move);
+
+    // load the network embedded in the binary
     static void Init();
 
+    // load a network from a .nn file. Returns false if the file cannot be read or does not match the architecture
+    static bool LoadFile(const std::string& path);
+
 private:
-    static int index(Square square, Pieces piece, Players view);
+    static int index(Square square, Pieces piece, Players view, size_t king_state);
+    static size_t king_state(const BoardState& board, Players view);
+    static size_t king_state(Square king, Players view);
+
+    static void LoadWeights(const unsigned char* net_data);
+
+    // the output of the network from the perspective of stm
+    static Score Output(const HalfAccumulator& acc, Players stm);
+
+    // build the accumulator from scratch for the given board
+    static void Refresh(const BoardState& board, HalfAccumulator& acc);
+
+    // bring the accumulator at the top of the stack up to date, by applying the deltas from the nearest computed
+    // ancestor or by refreshing from the cache if the king state has changed since then
+    const HalfAccumulator& Materialize(const BoardState& board);
+
+    // calculate one side of the accumulator for the board, using the refresh cache
+    void RefreshFromCache(const BoardState& board, Players view, std::array<int16_t, HIDDEN_NEURONS>& acc);
+    void ResetRefreshCache();
+
+    // The search applies at most MAX_DEPTH moves before returning, and we recalculate the accumulator from scratch when
+    // setting up a new position. The stack is allocated once so that pushing and popping never allocates or moves the
+    // accumulators during the search.
+    constexpr static size_t ACCUMULATOR_STACK_CAPACITY = MAX_DEPTH + 1;
+
+    std::unique_ptr<AccumulatorEntry[]> AccumulatorStack;
+    AccumulatorEntry* AccumulatorTop;
 
-    std::vector<HalfAccumulator> AccumulatorStack;
+    // [view][king state]
+    std::array<std::array<RefreshCacheEntry, KING_STATES>, N_PLAYERS> RefreshCache;
 
-    alignas(32) static std::array<std::array<int16_t, HIDDEN_NEURONS>, INPUT_NEURONS> hiddenWeights;
-    alignas(32) static std::array<int16_t, HIDDEN_NEURONS> hiddenBias;
-    alignas(32) static std::array<int16_t, HIDDEN_NEURONS * 2> outputWeights;
-    alignas(32) static int16_t outputBias;
+    alignas(64) static std::array<std::array<L1Weight, HIDDEN_NEURONS>, INPUT_NEURONS> hiddenWeights;
+    alignas(64) static std::array<int16_t, HIDDEN_NEURONS> hiddenBias;
+    // [input / 2][output][input % 2], where the side to move's half of the accumulator is the first HIDDEN_NEURONS
+    // inputs
+    alignas(64) static std::array<int16_t, HIDDEN_NEURONS * 2 * L2_NEURONS> l2Weights;
+    alignas(64) static std::array<int32_t, L2_NEURONS> l2Bias;
+    static OutputLayers outputLayers;
 };
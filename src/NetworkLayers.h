@@ -0,0 +1,86 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+
+// A fully connected float layer. The dimensions are template parameters, so the loops have compile time bounds and
+// are unrolled and vectorized for each layer. Weights are stored [in][out] so the inner loop runs across the outputs.
+template <size_t In, size_t Out>
+struct DenseLayer
+{
+    constexpr static size_t PARAMETERS = In * Out + Out;
+
+    alignas(64) std::array<std::array<float, Out>, In> weights;
+    alignas(64) std::array<float, Out> bias;
+
+    // nets store the weights [out][in], followed by the bias
+    void Load(const float*& data)
+    {
+        for (size_t i = 0; i < Out; i++)
+            for (size_t j = 0; j < In; j++)
+                weights[j][i] = *data++;
+
+        for (size_t i = 0; i < Out; i++)
+            bias[i] = *data++;
+    }
+
+    void Forward(const float* input, float* output) const
+    {
+        std::copy(bias.begin(), bias.end(), output);
+
+        for (size_t j = 0; j < In; j++)
+            for (size_t i = 0; i < Out; i++)
+                output[i] += input[j] * weights[j][i];
+    }
+};
+
+// A chain of dense layers with a ReLU between each, given by the size of each layer. For example,
+// DenseStack<16, 32, 1> takes 16 inputs, has a hidden layer of 32 neurons and a single output.
+template <size_t... Sizes>
+struct DenseStack;
+
+template <size_t In>
+struct DenseStack<In>
+{
+    constexpr static size_t OUTPUTS = In;
+    constexpr static size_t PARAMETERS = 0;
+
+    void Load(const float*&) { }
+
+    float Forward(const float* input) const
+    {
+        return input[0];
+    }
+};
+
+template <size_t In, size_t Out, size_t... Rest>
+struct DenseStack<In, Out, Rest...>
+{
+    using Next = DenseStack<Out, Rest...>;
+
+    constexpr static size_t OUTPUTS = Next::OUTPUTS;
+    constexpr static size_t PARAMETERS = DenseLayer<In, Out>::PARAMETERS + Next::PARAMETERS;
+
+    DenseLayer<In, Out> layer;
+    Next next;
+
+    void Load(const float*& data)
+    {
+        layer.Load(data);
+        next.Load(data);
+    }
+
+    float Forward(const float* input) const
+    {
+        alignas(64) std::array<float, Out> output;
+        layer.Forward(input, output.data());
+
+        if constexpr (sizeof...(Rest) > 0)
+        {
+            for (auto& neuron : output)
+                neuron = std::max(neuron, 0.f);
+        }
+
+        return next.Forward(output.data());
+    }
+};
@@ -0,0 +1,157 @@
+#include "Numa.h"
+
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <fstream>
+#include <string>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+std::vector<std::vector<int>> Numa::node_cpus;
+
+namespace
+{
+// Parse a list in the sysfs cpulist format, e.g "0-3,8,10-11". Returns an empty list if the list is invalid
+std::vector<int> parse_cpu_list(std::string_view list)
+{
+    std::vector<int> cpus;
+
+    while (!list.empty())
+    {
+        auto comma = list.find(',');
+        auto range = list.substr(0, comma);
+        list = comma == list.npos ? std::string_view {} : list.substr(comma + 1);
+
+        auto dash = std::min(range.find('-'), range.size());
+        int first = 0;
+        int last = 0;
+
+        auto [ptr1, ec1] = std::from_chars(range.data(), range.data() + dash, first);
+        if (ec1 != std::errc() || ptr1 != range.data() + dash)
+            return {};
+
+        if (dash == range.size())
+        {
+            last = first;
+        }
+        else
+        {
+            auto [ptr2, ec2] = std::from_chars(range.data() + dash + 1, range.data() + range.size(), last);
+            if (ec2 != std::errc() || ptr2 != range.data() + range.size() || last < first)
+                return {};
+        }
+
+        for (int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+
+    return cpus;
+}
+
+[[maybe_unused]] std::string read_line(const std::string& path)
+{
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+}
+
+bool Numa::configure(std::string_view setting)
+{
+    if (setting == "off")
+    {
+        node_cpus.clear();
+        return true;
+    }
+
+    std::vector<std::vector<int>> nodes;
+
+    if (setting == "auto")
+    {
+#ifdef __linux__
+        for (int node : parse_cpu_list(read_line("/sys/devices/system/node/online")))
+        {
+            auto cpus = parse_cpu_list(read_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+
+            // nodes with only memory don't run threads
+            if (!cpus.empty())
+                nodes.push_back(cpus);
+        }
+#endif
+    }
+    else
+    {
+        while (!setting.empty())
+        {
+            auto colon = setting.find(':');
+            nodes.push_back(parse_cpu_list(setting.substr(0, colon)));
+            setting = colon == setting.npos ? std::string_view {} : setting.substr(colon + 1);
+
+            if (nodes.back().empty())
+                return false;
+        }
+    }
+
+    if (nodes.empty())
+        return false;
+
+    node_cpus = nodes;
+    return true;
+}
+
+bool Numa::enabled()
+{
+    return !node_cpus.empty();
+}
+
+size_t Numa::node_count()
+{
+    return node_cpus.size();
+}
+
+void Numa::bind_thread([[maybe_unused]] int thread_id)
+{
+#ifdef __linux__
+    if (!enabled())
+        return;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    for (int cpu : node_cpus[thread_id % node_cpus.size()])
+    {
+        if (cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+    }
+
+    sched_setaffinity(0, sizeof(set), &set);
+#endif
+}
+
+void Numa::interleave([[maybe_unused]] void* addr, [[maybe_unused]] size_t bytes)
+{
+#ifdef __linux__
+    if (!enabled())
+        return;
+
+    auto memory_nodes = parse_cpu_list(read_line("/sys/devices/system/node/has_memory"));
+    if (memory_nodes.empty())
+        return;
+
+    // from linux/mempolicy.h, which isn't always installed
+    constexpr int MPOL_INTERLEAVE = 3;
+    constexpr size_t bits = sizeof(unsigned long) * CHAR_BIT;
+
+    std::vector<unsigned long> mask(*std::max_element(memory_nodes.begin(), memory_nodes.end()) / bits + 1);
+    for (int node : memory_nodes)
+        mask[node / bits] |= 1UL << (node % bits);
+
+    syscall(SYS_mbind, addr, bytes, MPOL_INTERLEAVE, mask.data(), mask.size() * bits + 1, 0);
+#endif
+}
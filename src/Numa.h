@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+// Optional NUMA aware placement, using the topology in sysfs and raw syscalls so that no external library is needed.
+// When enabled, search thread i is bound to the cpus of node i % node count, memory used by a single search thread is
+// first touched by a thread bound to the same node, and the transposition table is interleaved across all nodes.
+class Numa
+{
+public:
+    // "off" disables NUMA placement and "auto" reads the topology from sysfs. Otherwise the setting lists the cpus of
+    // each node separated by ':', in the sysfs cpulist format. For example "0-3,8-11:4-7,12-15" describes two nodes. An
+    // override like "0:0" can be used to test the code on a single node machine. Returns false for an invalid setting.
+    static bool configure(std::string_view setting);
+
+    static bool enabled();
+    static size_t node_count();
+
+    // bind the calling thread to the node that search thread thread_id runs on
+    static void bind_thread(int thread_id);
+
+    // Set the policy of a (not yet touched) page aligned range of memory to be interleaved across every node with
+    // memory. This uses the real nodes in sysfs, even when the cpu topology is overridden.
+    static void interleave(void* addr, size_t bytes);
+
+private:
+    // [node][cpu]
+    static std::vector<std::vector<int>> node_cpus;
+};
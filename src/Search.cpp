@@ -17,6 +17,7 @@
 #include "GameState.h"
 #include "MoveGeneration.h"
 #include "MoveList.h"
+#include "Numa.h"
 #include "Score.h"
 #include "SearchConstants.h"
 #include "SearchData.h"
@@ -84,8 +85,14 @@ void SearchThread(GameState& position, SearchSharedState& shared)
     {
         auto& local = shared.get_local_state(i);
         local.root_move_whitelist = root_move_whitelist;
-        threads.emplace_back(
-            std::thread([position, &local, &shared]() mutable { SearchPosition(position, local, shared); }));
+        threads.emplace_back(std::thread(
+            [&position, &local, &shared, i]()
+            {
+                // bind before copying the position, so the thread's copy is allocated on its own node
+                Numa::bind_thread(i);
+                GameState thread_position = position;
+                SearchPosition(thread_position, local, shared);
+            }));
     }
 
     for (size_t i = 0; i < threads.size(); i++)
@@ -235,6 +242,28 @@ bool should_abort_search(SearchLocalState& local, const SearchSharedState& share
     return false;
 }
 
+// Nodes shallower than local_tt_depth store into the thread local table when there is one
+TranspositionTable& tt_for_depth(SearchLocalState& local, int depth)
+{
+    return depth < local_tt_depth && local.local_tt.GetSize() > 0 ? local.local_tt : tTable;
+}
+
+// Issue loads for the memory the child node will touch once the move has survived pruning, so the cache misses overlap
+// with the extension and history work done before the move is applied. child_tt is the table the child will probe, or
+// nullptr if it won't probe one. Children that will be evaluated straight away also need the network
+// weight rows for the move.
+void prefetch_child(const GameState& position, const SearchLocalState& local, const TranspositionTable* child_tt,
+    Move move, bool prefetch_weights)
+{
+    const uint64_t key = position.Board().KeyAfter(move);
+    if (child_tt)
+        child_tt->PreFetch(key);
+    local.eval_cache->PreFetch(key);
+
+    if (prefetch_weights)
+        Network::PrefetchRows(position.Board(), move);
+}
+
 template <bool is_qsearch = false>
 std::optional<Score> init_search_node(const GameState& position, const int distance_from_root, SearchStackState* ss,
     SearchLocalState& local, const SearchSharedState& shared)
@@ -338,18 +367,31 @@ std::optional<Score> probe_egtb(const GameState& position, const int distance_fr
     return std::nullopt;
 }
 
-std::tuple<TTEntry*, Score, int, SearchResultType, Move> probe_tt(
-    const GameState& position, const int distance_from_root)
+std::tuple<std::optional<TTEntry>, Score, int, SearchResultType, Move> probe_tt(
+    const GameState& position, SearchLocalState& local, const int distance_from_root, const int depth)
 {
-    // copy the values out of the table that we want, to avoid race conditions
-    auto* tt_entry
-        = tTable.GetEntry(position.Board().GetZobristKey(), distance_from_root, position.Board().half_turn_count);
-    const auto tt_score = tt_entry
-        ? convert_from_tt_score(tt_entry->score.load(std::memory_order_relaxed), distance_from_root)
-        : SCORE_UNDEFINED;
-    const auto tt_depth = tt_entry ? tt_entry->depth.load(std::memory_order_relaxed) : 0;
-    const auto tt_cutoff = tt_entry ? tt_entry->cutoff.load(std::memory_order_relaxed) : SearchResultType::EMPTY;
-    const auto tt_move = tt_entry ? tt_entry->move.load(std::memory_order_relaxed) : Move::Uninitialized;
+    const auto key = position.Board().GetZobristKey();
+    const auto half_turn_count = position.Board().half_turn_count;
+
+    // Nodes try the table they store into first, then fall back to the other one. That way shallow nodes can find an
+    // entry stored by a deeper search, and a node searched deeper than before still finds its own best move.
+    TranspositionTable* table = &tt_for_depth(local, depth);
+    std::optional<TTEntry> tt_entry = table->GetEntry(key, distance_from_root, half_turn_count);
+    if (!tt_entry && local.local_tt.GetSize() > 0)
+    {
+        table = table == &tTable ? &local.local_tt : &tTable;
+        tt_entry = table->GetEntry(key, distance_from_root, half_turn_count);
+    }
+
+    const auto tt_score = tt_entry ? convert_from_tt_score(tt_entry->score, distance_from_root) : SCORE_UNDEFINED;
+    const auto tt_depth = tt_entry ? tt_entry->depth : 0;
+    const auto tt_cutoff = tt_entry ? tt_entry->cutoff : SearchResultType::EMPTY;
+    const auto tt_move = tt_entry ? tt_entry->move : Move::Uninitialized;
+
+#ifdef TT_STATS
+    if (tt_move != Move::Uninitialized && !MoveIsLegal(position.Board(), tt_move))
+        table->RecordCollision();
+#endif
 
     return { tt_entry, tt_score, tt_depth, tt_cutoff, tt_move };
 }
@@ -595,17 +637,19 @@ Score TerminalScore(const BoardState& board, int distanceFromRoot)
 }
 
 void AddScoreToTable(Score score, Score alphaOriginal, const BoardState& board, int depthRemaining,
-    int distanceFromRoot, Score beta, Move bestMove)
+    int distanceFromRoot, Score beta, Move bestMove, Score static_eval, SearchLocalState& local)
 {
+    auto& table = tt_for_depth(local, depthRemaining);
+
     if (score <= alphaOriginal)
-        tTable.AddEntry(bestMove, board.GetZobristKey(), score, depthRemaining, board.half_turn_count, distanceFromRoot,
-            SearchResultType::UPPER_BOUND); // mate score adjustent is done inside this function
+        table.AddEntry(bestMove, board.GetZobristKey(), score, static_eval, depthRemaining, board.half_turn_count,
+            distanceFromRoot, SearchResultType::UPPER_BOUND); // mate score adjustent is done inside this function
     else if (score >= beta)
-        tTable.AddEntry(bestMove, board.GetZobristKey(), score, depthRemaining, board.half_turn_count, distanceFromRoot,
-            SearchResultType::LOWER_BOUND);
+        table.AddEntry(bestMove, board.GetZobristKey(), score, static_eval, depthRemaining, board.half_turn_count,
+            distanceFromRoot, SearchResultType::LOWER_BOUND);
     else
-        tTable.AddEntry(bestMove, board.GetZobristKey(), score, depthRemaining, board.half_turn_count, distanceFromRoot,
-            SearchResultType::EXACT);
+        table.AddEntry(bestMove, board.GetZobristKey(), score, static_eval, depthRemaining, board.half_turn_count,
+            distanceFromRoot, SearchResultType::EXACT);
 }
 
 template <SearchType search_type>
@@ -641,7 +685,8 @@ SearchResult NegaScout(GameState& position, SearchStackState* ss, SearchLocalSta
     }
 
     // Step 3: Probe transposition table
-    const auto [tt_entry, tt_score, tt_depth, tt_cutoff, tt_move] = probe_tt(position, distance_from_root);
+    const auto [tt_entry, tt_score, tt_depth, tt_cutoff, tt_move]
+        = probe_tt(position, local, distance_from_root, depth);
 
     // Step 4: Check if we can use the TT entry to return early
     if (!pv_node && ss->singular_exclusion == Move::Uninitialized && tt_entry && tt_depth >= depth)
@@ -661,7 +706,8 @@ SearchResult NegaScout(GameState& position, SearchStackState* ss, SearchLocalSta
         return Quiescence<qsearch_type>(position, ss, local, shared, depth, alpha, beta);
     }
 
-    const auto staticScore = EvaluatePositionNet(position, local.eval_cache);
+    // the static eval is stored alongside the search result, so a TT hit saves evaluating the position
+    const auto staticScore = tt_entry ? tt_entry->static_eval : EvaluatePositionNet(position, *local.eval_cache);
 
     // Step 6: Static null move pruning (a.k.a reverse futility pruning)
     //
@@ -745,6 +791,9 @@ SearchResult NegaScout(GameState& position, SearchStackState* ss, SearchLocalSta
             }
         }
 
+        // only moves that survived pruning are worth prefetching for
+        prefetch_child(position, local, &tt_for_depth(local, depth - 1), move, depth <= 1);
+
         int extensions = 0;
 
         // Step 13: Singular extensions.
@@ -768,7 +817,6 @@ SearchResult NegaScout(GameState& position, SearchStackState* ss, SearchLocalSta
         int history = local.history.get(position, ss, move);
         ss->move = move;
         position.ApplyMove(move);
-        tTable.PreFetch(position.Board().GetZobristKey()); // load the transposition into l1 cache. ~5% speedup
 
         // Step 14: Check extensions
         if (IsInCheck(position.Board()))
@@ -806,7 +854,8 @@ SearchResult NegaScout(GameState& position, SearchStackState* ss, SearchLocalSta
     // Step 18: Update transposition table
     if (!local.aborting_search && ss->singular_exclusion == Move::Uninitialized)
     {
-        AddScoreToTable(score, original_alpha, position.Board(), depth, distance_from_root, beta, bestMove);
+        AddScoreToTable(
+            score, original_alpha, position.Board(), depth, distance_from_root, beta, bestMove, staticScore, local);
     }
 
     return SearchResult(score, bestMove);
@@ -829,7 +878,7 @@ SearchResult Quiescence(GameState& position, SearchStackState* ss, SearchLocalSt
 
     // Step 2: Stand-pat. We assume if all captures are bad, there's at least one quiet move that maintains the static
     // score
-    auto staticScore = EvaluatePositionNet(position, local.eval_cache);
+    auto staticScore = EvaluatePositionNet(position, *local.eval_cache);
     alpha = std::max(alpha, staticScore);
     if (alpha >= beta)
     {
@@ -858,6 +907,8 @@ SearchResult Quiescence(GameState& position, SearchStackState* ss, SearchLocalSt
             break;
         }
 
+        prefetch_child(position, local, nullptr, move, true);
+
         ss->move = move;
         position.ApplyMove(move);
         auto search_score
@@ -34,3 +34,6 @@ inline auto Initialise_LMR_reduction()
 
 // [depth][move number]
 TUNEABLE_CONSTANT std::array<std::array<int, 64>, 64> LMR_reduction = Initialise_LMR_reduction();
+
+// when the thread local transposition table is enabled, nodes below this depth use it instead of the shared table
+TUNEABLE_CONSTANT int local_tt_depth = 3;
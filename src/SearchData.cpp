@@ -4,10 +4,12 @@
 #include <cstdint>
 #include <mutex>
 #include <numeric>
+#include <thread>
 
 #include "BitBoardDefine.h"
 #include "Move.h"
 #include "MoveList.h"
+#include "Numa.h"
 #include "Score.h"
 #include "Search.h"
 #include "uci/uci.h"
@@ -89,6 +91,7 @@ void SearchLocalState::ResetNewGame()
 {
     ResetNewSearch();
     history.reset();
+    local_tt.NewGame();
 }
 
 SearchSharedState::SearchSharedState(Uci& uci)
@@ -127,17 +130,89 @@ void SearchSharedState::set_multi_pv(int multi_pv)
     }
 }
 
+// Run f on a thread bound to the NUMA node of search thread thread_id, so that the memory it first touches is local to
+// that search thread
+template <typename F>
+void run_on_node(int thread_id, F&& f)
+{
+    if (!Numa::enabled())
+        return f();
+
+    std::thread(
+        [&]
+        {
+            Numa::bind_thread(thread_id);
+            f();
+        })
+        .join();
+}
+
 void SearchSharedState::set_threads(int threads)
 {
     threads_setting = threads;
 
     search_local_states_.clear();
+    search_local_states_.resize(threads_setting);
     for (int i = 0; i < threads_setting; i++)
     {
-        search_local_states_.emplace_back(std::make_unique<SearchLocalState>(i));
+        run_on_node(i, [&] { search_local_states_[i] = std::make_unique<SearchLocalState>(i); });
     }
 
     search_results_.resize(threads, decltype(search_results_)::value_type(multi_pv_setting));
+    configure_eval_caches();
+    configure_local_tts();
+}
+
+void SearchSharedState::set_eval_cache_size(int MB)
+{
+    eval_cache_size_setting = MB;
+    configure_eval_caches();
+}
+
+void SearchSharedState::set_shared_eval_cache(bool shared)
+{
+    shared_eval_cache_setting = shared;
+    configure_eval_caches();
+}
+
+void SearchSharedState::set_local_tt_size(int KB)
+{
+    local_tt_size_setting = KB;
+    configure_local_tts();
+}
+
+void SearchSharedState::reset_cached_evals()
+{
+    shared_eval_cache_.Reset();
+
+    for (auto& local : search_local_states_)
+    {
+        local->local_eval_cache.Reset();
+        local->local_tt.ResetTable();
+    }
+}
+
+void SearchSharedState::configure_local_tts()
+{
+    for (int i = 0; i < threads_setting; i++)
+    {
+        auto& local = *search_local_states_[i];
+        run_on_node(i, [&] { local.local_tt.SetSizeKB(local_tt_size_setting); });
+    }
+}
+
+void SearchSharedState::configure_eval_caches()
+{
+    // only allocate the caches that will be used
+    shared_eval_cache_.SetSize(shared_eval_cache_setting ? eval_cache_size_setting : 0);
+
+    for (int i = 0; i < threads_setting; i++)
+    {
+        auto& local = *search_local_states_[i];
+        run_on_node(
+            i, [&] { local.local_eval_cache.SetSize(shared_eval_cache_setting ? 0 : eval_cache_size_setting); });
+        local.eval_cache = shared_eval_cache_setting ? &shared_eval_cache_ : &local.local_eval_cache;
+    }
 }
 
 SearchResults SearchSharedState::get_best_search_result() const
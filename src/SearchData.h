@@ -81,7 +81,12 @@ public:
 
     const int thread_id;
     SearchStack search_stack;
-    EvalCacheTable eval_cache;
+    EvalCacheTable local_eval_cache { 0 };
+    EvalCacheTable* eval_cache = &local_eval_cache; // either local_eval_cache, or the cache shared by all threads
+
+    // A small table for shallow nodes, which keeps them out of the shared table and stays in this core's cache. Empty
+    // unless enabled with the LocalHash option.
+    TranspositionTable local_tt { TTUsage::THREAD_LOCAL };
     History history;
     int sel_septh = 0;
     std::atomic<uint64_t> tb_hits = 0;
@@ -133,6 +138,13 @@ public:
     void ResetNewGame();
     void set_multi_pv(int multi_pv);
     void set_threads(int threads);
+    void set_eval_cache_size(int MB);
+    void set_shared_eval_cache(bool shared);
+    void set_local_tt_size(int KB);
+
+    // Empty every eval cache and thread local transposition table, whose entries hold static evaluations from the
+    // current network
+    void reset_cached_evals();
 
     // Below functions are thread-safe and blocking
     // ------------------------------------
@@ -162,6 +174,9 @@ private:
     mutable std::recursive_mutex lock_;
     int multi_pv_setting {};
     int threads_setting {};
+    size_t eval_cache_size_setting = EvalCacheTable::DEFAULT_SIZE_MB;
+    bool shared_eval_cache_setting = false;
+    size_t local_tt_size_setting = 0;
 
     // [thread_id][multi_pv][depth]
     std::vector<std::vector<std::array<SearchResults, MAX_DEPTH + 1>>> search_results_;
@@ -171,4 +186,12 @@ private:
     // We persist the SearchLocalStates for each thread we have, so that they don't need to be reconstructed each time
     // we start a search.
     std::vector<std::unique_ptr<SearchLocalState>> search_local_states_;
+
+    // Used instead of a cache per thread when shared_eval_cache_setting is set, so that threads can use each other's
+    // evaluations.
+    EvalCacheTable shared_eval_cache_ { 0 };
+
+    // allocate and assign the eval caches according to the current settings
+    void configure_eval_caches();
+    void configure_local_tts();
 };
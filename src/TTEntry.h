@@ -8,35 +8,57 @@
 #include "Move.h"
 #include "Score.h"
 
-constexpr unsigned int HALF_MOVE_MODULO = 16;
+// 15 rather than 16, so the generation fits in 4 bits
+constexpr unsigned int HALF_MOVE_MODULO = 15;
 
 Score convert_to_tt_score(Score val, int distance_from_root);
 Score convert_from_tt_score(Score val, int distance_from_root);
 uint8_t get_generation(int currentTurnCount, int distanceFromRoot);
 
-// 16 bytes
-class TTEntry
+// A copy of an entry in the table. The table stores each entry packed into a single 64 bit word.
+struct TTEntry
 {
-public:
-    TTEntry() = default;
-
-    /*Arranged to minimize padding*/
-    std::atomic<uint64_t> key = 0; // 8 bytes
-    std::atomic<Move> move = Move::Uninitialized; // 2 bytes
-    std::atomic<Score> score { 0 }; // 2 bytes
-    std::atomic<int8_t> depth = 0; // 1 bytes
-    std::atomic<SearchResultType> cutoff = SearchResultType::EMPTY; // 1 bytes
-    // is stored as the move count at the ROOT of this current search modulo 16 plus 1
-    std::atomic<int8_t> generation = 0; // 1 bytes
+    Move move = Move::Uninitialized;
+    Score score = 0;
+    Score static_eval = 0;
+    int8_t depth = 0;
+    SearchResultType cutoff = SearchResultType::EMPTY;
+    // is stored as the move count at the ROOT of this current search modulo 15 plus 1, in the low 4 bits. The bits
+    // above are used by the table to tell games apart.
+    int8_t generation = 0;
+
+    // move: 16 bits, score: 16 bits, static eval: 16 bits, depth: 8 bits, cutoff: 2 bits, generation: 6 bits
+    static constexpr int GENERATION_BITS = 6;
+    static constexpr int GENERATION_SHIFT = 64 - GENERATION_BITS;
+
+    uint64_t Pack() const
+    {
+        return uint64_t(move.GetData()) | uint64_t(uint16_t(score.value())) << 16
+            | uint64_t(uint16_t(static_eval.value())) << 32 | uint64_t(uint8_t(depth)) << 48
+            | uint64_t(cutoff) << 56 | uint64_t(generation) << GENERATION_SHIFT;
+    }
+
+    static TTEntry Unpack(uint64_t data)
+    {
+        return { Move(uint16_t(data)), int16_t(data >> 16), int16_t(data >> 32), int8_t(data >> 48),
+            SearchResultType((data >> 56) & 0x3), int8_t(data >> GENERATION_SHIFT) };
+    }
 };
 
-struct alignas(64) TTBucket : public std::array<TTEntry, 4>
+// 64 bytes: six entries, each stored as a packed 64 bit data word and a 16 bit key check. The key check holds the bits
+// of the key just below the bucket index XORed with a fold of the data word, see TranspositionTable::KeyCheck. Each is
+// read and written as a single plain word. An entry with a data word of zero is empty, because the generation of a
+// stored entry is never zero.
+struct alignas(64) TTBucket
 {
-    constexpr static auto size = 4;
+    constexpr static size_t size = 6;
+
+    std::array<std::atomic<uint64_t>, size> data = {};
+    std::array<std::atomic<uint16_t>, size> key_check = {};
 };
 
-static_assert(sizeof(TTEntry) == 16, "TTEntry is not 16 bytes");
 static_assert(sizeof(TTBucket) == 64, "TTBucket is not 64 bytes");
 static_assert(alignof(TTBucket) == 64, "TTBucket alignment is not 64 bytes");
 static_assert(std::is_trivially_copyable_v<TTBucket>);
 static_assert(std::is_trivially_destructible_v<TTBucket>);
+static_assert(HALF_MOVE_MODULO < 16);
@@ -2,19 +2,147 @@
 
 #include <algorithm>
 #include <array>
+#include <cassert>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
 #include <iterator>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #ifdef __linux__
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
 #include "BitBoardDefine.h"
+#include "Numa.h"
 #include "TTEntry.h"
 
+std::ostream& operator<<(std::ostream& os, TTPageType type)
+{
+    switch (type)
+    {
+    case TTPageType::HUGE_1GB:
+        return os << "1GB huge pages";
+    case TTPageType::HUGE_2MB:
+        return os << "2MB huge pages";
+    case TTPageType::TRANSPARENT:
+        return os << "transparent huge pages";
+    case TTPageType::NORMAL:
+        return os << "normal pages";
+    case TTPageType::SHARED:
+        return os << "shared memory";
+    }
+
+    return os;
+}
+
+// The generation of an entry holds the move count it was written at in the low bits, and which game it was written in
+// the bits above. The game only cycles through a few values, which is enough to tell the last few games apart.
+constexpr int GAME_SHIFT = 4;
+constexpr int GAME_COUNT = 4;
+constexpr int8_t GENERATION_MASK = (1 << GAME_SHIFT) - 1;
+static_assert(HALF_MOVE_MODULO <= GENERATION_MASK);
+static_assert((GAME_COUNT << GAME_SHIFT) <= (1 << TTEntry::GENERATION_BITS));
+
+namespace
+{
+// Split the range [0, count) of buckets into contiguous chunks, and run func(begin, end) on each chunk in parallel.
+// Each thread gets at least 1MB worth of buckets, so that small tables aren't slowed down by starting threads.
+template <typename F>
+void parallel_for_buckets(size_t count, size_t threads, F&& func)
+{
+    constexpr size_t min_chunk_size = 1024 * 1024 / sizeof(TTBucket);
+    const size_t thread_count = std::clamp<size_t>(count / min_chunk_size, 1, threads);
+    const size_t chunk_size = (count + thread_count - 1) / thread_count;
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < thread_count; i++)
+    {
+        workers.emplace_back(
+            [&func, begin = std::min(count, i * chunk_size), end = std::min(count, (i + 1) * chunk_size)]
+            { func(begin, end); });
+    }
+
+    func(0, std::min(count, chunk_size));
+
+    for (auto& worker : workers)
+        worker.join();
+}
+
+// The key check is stored XORed with a fold of the data word. The two are separate words, so a read can see the data
+// from one write and the key check from another, and this makes such a torn read fail the key check. The generation
+// is left out, so it can be refreshed without rewriting the key check.
+uint16_t fold_data(uint64_t data)
+{
+    data &= (uint64_t(1) << TTEntry::GENERATION_SHIFT) - 1;
+    return data ^ (data >> 16) ^ (data >> 32) ^ (data >> 48);
+}
+
+#ifdef TT_STATS
+// [usage]
+using UsageStats = std::array<TTStats, 2>;
+
+std::mutex stats_mutex;
+std::vector<UsageStats*> live_stats;
+UsageStats retired_stats;
+
+// registers itself so the counters can be summed, and adds the counters to retired_stats when the thread exits
+struct ThreadStats : UsageStats
+{
+    ThreadStats()
+    {
+        std::lock_guard lock(stats_mutex);
+        live_stats.push_back(this);
+    }
+
+    ~ThreadStats()
+    {
+        std::lock_guard lock(stats_mutex);
+        for (size_t i = 0; i < size(); i++)
+            retired_stats[i] += (*this)[i];
+        live_stats.erase(std::find(live_stats.begin(), live_stats.end(), this));
+    }
+};
+
+thread_local ThreadStats thread_stats;
+#endif
+}
+
+// Saved tables start with this header, followed by the raw buckets. The buckets are written in the memory layout of
+// this build, so a table can only be loaded by a build with the same entry format on the same kind of machine.
+struct TTFileHeader
+{
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t bucket_bytes;
+    uint64_t size;
+    uint64_t key_salt;
+    uint64_t game;
+};
+
+constexpr std::array<char, 8> TT_FILE_MAGIC = { 'H', 'A', 'L', 'O', 'G', 'E', 'N', 'T' };
+
+// increase this whenever the layout of TTBucket changes
+constexpr uint32_t TT_FILE_VERSION = 3;
+
+TranspositionTable::TranspositionTable(TTUsage usage)
+    : usage_(usage)
+{
+}
+
 TranspositionTable ::~TranspositionTable()
 {
     Deallocate();
@@ -22,74 +150,126 @@ TranspositionTable ::~TranspositionTable()
 
 uint64_t TranspositionTable::HashFunction(const uint64_t& key) const
 {
-    return key & hash_mask_;
+    // The high 64 bits of key * size_ are evenly distributed over [0, size_), which allows any table size without a
+    // division or a branch
+    return (static_cast<unsigned __int128>(key ^ key_salt_) * size_) >> 64;
 }
 
-void TranspositionTable::AddEntry(const Move& best, uint64_t ZobristKey, Score score, int Depth, int Turncount,
-    int distanceFromRoot, SearchResultType Cutoff)
+uint16_t TranspositionTable::KeyCheck(const uint64_t& key) const
 {
-    size_t hash = HashFunction(ZobristKey);
-    score = convert_to_tt_score(score, distanceFromRoot);
+    // The 16 bits of the product below the bucket index. Together with the index, this is the position of the key in
+    // [0, size_) to 16 fractional bits, which is enough to move the entry into a table of a different size.
+    return static_cast<uint64_t>(static_cast<unsigned __int128>(key ^ key_salt_) * size_) >> 48;
+}
+
+void TranspositionTable::AddEntry(const Move& best, uint64_t ZobristKey, Score score, Score static_eval, int Depth,
+    int Turncount, int distanceFromRoot, SearchResultType Cutoff)
+{
+    Store(table[HashFunction(ZobristKey)], KeyCheck(ZobristKey),
+        { best, convert_to_tt_score(score, distanceFromRoot), static_eval, static_cast<int8_t>(Depth), Cutoff,
+            Generation(Turncount, distanceFromRoot) });
+}
 
+void TranspositionTable::Store(TTBucket& bucket, uint16_t key_check, const TTEntry& entry)
+{
     // Keep in mind age from each generation goes up so lower (generally) means older
-    int8_t current_generation = get_generation(Turncount, distanceFromRoot);
     std::array<int8_t, TTBucket::size> scores = {};
-    auto& bucket = table[hash];
 
-    const auto write_to_entry = [&](auto& entry)
+    const auto write_to_entry = [&](size_t i)
     {
-        entry.move = best;
-        entry.key = ZobristKey;
-        entry.score = score;
-        entry.depth = Depth;
-        entry.cutoff = Cutoff;
-        entry.generation = current_generation;
+        const uint64_t data = entry.Pack();
+        bucket.data[i].store(data, std::memory_order_relaxed);
+        bucket.key_check[i].store(key_check ^ fold_data(data), std::memory_order_relaxed);
     };
 
     for (size_t i = 0; i < TTBucket::size; i++)
     {
+        const uint64_t data = bucket.data[i].load(std::memory_order_relaxed);
+
         // each bucket fills from the first entry, and only once all entries are full do we use the replacement scheme
-        if (bucket[i].key == EMPTY)
+        if (data == 0)
         {
-            write_to_entry(bucket[i]);
+#ifdef TT_STATS
+            Counters().replacements[TTStats::EMPTY_SLOT]++;
+#endif
+            write_to_entry(i);
             return;
         }
 
+        const auto old = TTEntry::Unpack(data);
+
         // avoid having multiple entries in a bucket for the same position.
-        if (bucket[i].key == ZobristKey)
+        if ((bucket.key_check[i].load(std::memory_order_relaxed) ^ fold_data(data)) == key_check)
         {
             // always replace if exact, or if the depth is sufficiently high. There's a trade-off here between wanting
             // to save the higher depth entry, and wanting to save the newer entry (which might have better bounds)
-            if (Cutoff == SearchResultType::EXACT || Depth >= bucket[i].depth - 3)
+            if (entry.cutoff == SearchResultType::EXACT || entry.depth >= old.depth - 3)
             {
-                write_to_entry(bucket[i]);
+#ifdef TT_STATS
+                Counters().replacements[TTStats::SAME_KEY]++;
+#endif
+                write_to_entry(i);
             }
             return;
         }
 
-        int8_t age_diff = current_generation - bucket[i].generation;
-        scores[i] = bucket[i].depth - 4 * (age_diff >= 0 ? age_diff : age_diff + HALF_MOVE_MODULO);
+        // entries from an earlier game are always replaced first
+        if ((old.generation & ~GENERATION_MASK) != (entry.generation & ~GENERATION_MASK))
+        {
+            scores[i] = std::numeric_limits<int8_t>::min();
+            continue;
+        }
+
+        int8_t age_diff = entry.generation - old.generation;
+        scores[i] = old.depth - 4 * (age_diff >= 0 ? age_diff : age_diff + HALF_MOVE_MODULO);
     }
 
-    write_to_entry(bucket[std::distance(scores.begin(), std::min_element(scores.begin(), scores.end()))]);
+    const size_t replaced = std::distance(scores.begin(), std::min_element(scores.begin(), scores.end()));
+
+#ifdef TT_STATS
+    const auto replaced_generation = TTEntry::Unpack(bucket.data[replaced].load(std::memory_order_relaxed)).generation;
+    Counters().replacements[replaced_generation == entry.generation ? TTStats::SHALLOWER : TTStats::AGED]++;
+#endif
+
+    write_to_entry(replaced);
 }
 
-TTEntry* TranspositionTable::GetEntry(uint64_t key, int distanceFromRoot, int half_turn_count)
+std::optional<TTEntry> TranspositionTable::GetEntry(uint64_t key, int distanceFromRoot, int half_turn_count)
 {
-    size_t index = HashFunction(key);
+    auto& bucket = table[HashFunction(key)];
+    const uint16_t key_check = KeyCheck(key);
+
+#ifdef TT_STATS
+    Counters().probes++;
+#endif
 
     // we return by copy here because other threads are reading/writing to this same table.
-    for (auto& entry : table[index])
+    for (size_t i = 0; i < TTBucket::size; i++)
     {
-        if (entry.key == key)
+        uint64_t data = bucket.data[i].load(std::memory_order_relaxed);
+
+        if (data != 0 && (bucket.key_check[i].load(std::memory_order_relaxed) ^ fold_data(data)) == key_check)
         {
-            // reset the age of this entry to mark it as not old
-            entry.generation = get_generation(half_turn_count, distanceFromRoot);
-            return &entry;
+            auto entry = TTEntry::Unpack(data);
+            const int8_t generation = Generation(half_turn_count, distanceFromRoot);
+
+            // Reset the age of this entry to mark it as not old. Most hits are on entries already written or refreshed
+            // this search, and skipping the write keeps the cache line clean on other cores. The compare exchange
+            // means a concurrent write of a different entry isn't overwritten with the stale data.
+            if (entry.generation != generation)
+            {
+                entry.generation = generation;
+                bucket.data[i].compare_exchange_strong(data, entry.Pack(), std::memory_order_relaxed);
+            }
+
+#ifdef TT_STATS
+            Counters().hits++;
+#endif
+            return entry;
         }
     }
 
-    return nullptr;
+    return std::nullopt;
 }
 
 int TranspositionTable::GetCapacity(int halfmove) const
@@ -98,7 +278,8 @@ int TranspositionTable::GetCapacity(int halfmove) const
 
     for (int i = 0; i < 1000; i++) // 1000 chosen specifically, because result needs to be 'per mill'
     {
-        if (table[i / TTBucket::size][i % TTBucket::size].generation == get_generation(halfmove, 0))
+        const uint64_t data = table[i / TTBucket::size].data[i % TTBucket::size].load(std::memory_order_relaxed);
+        if (TTEntry::Unpack(data).generation == Generation(halfmove, 0))
             count++;
     }
 
@@ -107,47 +288,371 @@ int TranspositionTable::GetCapacity(int halfmove) const
 
 void TranspositionTable::ResetTable()
 {
-    Reallocate();
+    Clear();
+}
+
+void TranspositionTable::NewGame()
+{
+    // every process sharing the table must hash keys the same way, and may be playing a different game
+    if (!shm_name_.empty())
+        return;
+
+    // an odd constant (the golden ratio) cycles through every 64 bit value before repeating
+    key_salt_ += 0x9E3779B97F4A7C15;
+    game_ = (game_ + 1) % GAME_COUNT;
+}
+
+int8_t TranspositionTable::Generation(int half_turn_count, int distance_from_root) const
+{
+    return get_generation(half_turn_count, distance_from_root) | (game_ << GAME_SHIFT);
+}
+
+void TranspositionTable::SetThreads(int threads)
+{
+    threads_ = threads;
+}
+
+void TranspositionTable::Clear()
+{
+    parallel_for_buckets(size_, threads_,
+        [this](size_t begin, size_t end) { std::uninitialized_default_construct(table + begin, table + end); });
+}
+
+bool TranspositionTable::SetSize(uint64_t MB, bool require_large_pages)
+{
+    return SetSizeKB(MB * 1024, require_large_pages);
+}
+
+bool TranspositionTable::SetSizeKB(uint64_t KB, bool require_large_pages)
+{
+    // The shared memory is attached again at the new size. Re-inserting isn't possible, because the old and new table
+    // can be the same memory. If the segment exists with a different size, the table falls back to private memory and
+    // leaves shared mode, so that new games invalidate it again.
+    if (!shm_name_.empty())
+    {
+        Deallocate();
+        size_ = CalculateEntryCount(KB);
+        Allocate();
+
+        if (page_type_ != TTPageType::SHARED)
+            shm_name_.clear();
+
+        return true;
+    }
+
+    // A larger table can't hold the old entries, so the old table is freed first rather than kept alongside it. It
+    // is only kept when it might be needed again, because the new table could fail to get large pages.
+    if (CalculateEntryCount(KB) > size_ && !require_large_pages)
+    {
+        Deallocate();
+        size_ = CalculateEntryCount(KB);
+        Allocate();
+        return true;
+    }
+
+    // the old table stays allocated until its entries have been moved into the new one
+    TTBucket* old_table = std::exchange(table, nullptr);
+    const size_t old_size = std::exchange(size_, CalculateEntryCount(KB));
+    const TTPageType old_page_type = page_type_;
+
+    Allocate();
+
+    if (require_large_pages && !UsesLargePages())
+    {
+        Deallocate();
+        table = old_table;
+        size_ = old_size;
+        page_type_ = old_page_type;
+        return false;
+    }
+
+    if (old_table)
+    {
+        if (table && size_ <= old_size)
+            Reinsert(old_table, 0, old_size, old_size);
+
+        Free(old_table, old_size, old_page_type);
+    }
+
+    return true;
+}
+
+void TranspositionTable::Reinsert(const TTBucket* buckets, size_t first, size_t count, size_t old_size)
+{
+    const int8_t current_game = game_ << GAME_SHIFT;
+
+    // The full key isn't stored, but the bucket index and key check give the position of the key in [0, old_size) to
+    // 16 fractional bits. Scaling both ends of that range down to the new size gives the new bucket index and key
+    // check when they agree. When they don't, the entry could belong in either place, so it is dropped rather than
+    // stored where it may never be found. Halving the table keeps every entry, but other ratios drop some, e.g a third
+    // of them when going from 96MB to 64MB. A larger table would need fractional bits that aren't known, so growing
+    // doesn't re-insert.
+    //
+    // The position grows with the key, so each contiguous chunk of old buckets maps to a contiguous range of new
+    // buckets, and threads can only write to the same bucket at the edges of their chunks. Like during search, a rare
+    // racing write to one of those buckets just loses an entry.
+    assert(size_ <= old_size);
+
+    parallel_for_buckets(count, threads_,
+        [&](size_t begin, size_t end)
+        {
+            for (size_t i = first + begin; i < first + end; i++)
+            {
+                for (size_t j = 0; j < TTBucket::size; j++)
+                {
+                    const uint64_t data = buckets[i - first].data[j].load(std::memory_order_relaxed);
+                    const auto entry = TTEntry::Unpack(data);
+
+                    // entries from earlier games can't be matched any more, so aren't worth keeping
+                    if (data == 0 || (entry.generation & ~GENERATION_MASK) != current_game)
+                        continue;
+
+                    // the range of positions [low, low + 1) in fixed point with 16 fractional bits, scaled to the new
+                    // size. Integer division rounds both ends down, so high is the last position the key could have.
+                    const uint16_t key_check
+                        = buckets[i - first].key_check[j].load(std::memory_order_relaxed) ^ fold_data(data);
+                    const auto low = (static_cast<unsigned __int128>(i) << 16) + key_check;
+                    const auto position = low * size_ / old_size;
+                    const auto high = ((low + 1) * size_ - 1) / old_size;
+
+                    if (position != high)
+                        continue;
+
+                    Store(table[static_cast<size_t>(position >> 16)], static_cast<uint16_t>(position), entry);
+                }
+            }
+        });
+}
+
+#ifdef __linux__
+bool TransparentHugePagesEnabled()
+{
+    // the active mode is shown in brackets, e.g "always [madvise] never"
+    std::ifstream file("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::string mode;
+    return std::getline(file, mode) && mode.find("[never]") == std::string::npos;
+}
+#endif
+
+bool TranspositionTable::Save(const std::string& path) const
+{
+    std::ofstream file(path, std::ios::binary);
+    const TTFileHeader header { TT_FILE_MAGIC, TT_FILE_VERSION, sizeof(TTBucket), size_, key_salt_,
+        static_cast<uint64_t>(game_) };
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(table), size_ * sizeof(TTBucket));
+    return static_cast<bool>(file);
 }
 
-void TranspositionTable::SetSize(uint64_t MB)
+TTLoadResult TranspositionTable::Load(const std::string& path)
 {
-    size_ = CalculateEntryCount(MB);
-    hash_mask_ = size_ - 1;
-    Reallocate();
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return TTLoadResult::FILE_ERROR;
+
+    TTFileHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != TT_FILE_MAGIC)
+        return TTLoadResult::INVALID_FORMAT;
+
+    if (header.version != TT_FILE_VERSION || header.bucket_bytes != sizeof(TTBucket))
+        return TTLoadResult::INVALID_VERSION;
+
+    // loading would change the salt, which every process sharing the table relies on
+    if (!shm_name_.empty())
+        return TTLoadResult::SHARED_TABLE;
+
+    if (header.size < size_)
+        return TTLoadResult::SMALLER_TABLE;
+
+    // the stored keys only match positions when using the salt they were written with
+    key_salt_ = header.key_salt;
+    game_ = static_cast<int>(header.game % GAME_COUNT);
+    Clear();
+
+    if (header.size == size_)
+    {
+        file.read(reinterpret_cast<char*>(table), size_ * sizeof(TTBucket));
+    }
+    else
+    {
+        // a larger table is read in chunks, which are re-inserted like when shrinking
+        std::vector<TTBucket> chunk(1024 * 1024 / sizeof(TTBucket));
+
+        for (uint64_t first = 0; first < header.size && file; first += chunk.size())
+        {
+            const size_t count = std::min<uint64_t>(header.size - first, chunk.size());
+            if (file.read(reinterpret_cast<char*>(chunk.data()), count * sizeof(TTBucket)))
+                Reinsert(chunk.data(), first, count, header.size);
+        }
+    }
 
-    // size should be a power of two
-    assert(GetBitCount(size_) == 1);
+    // don't keep half a table from a truncated file
+    if (!file)
+    {
+        Clear();
+        return TTLoadResult::FILE_ERROR;
+    }
+
+    return TTLoadResult::OK;
 }
 
 void TranspositionTable::Reallocate()
 {
     Deallocate();
+    Allocate();
+}
 
+bool TranspositionTable::SetSharedMemory(const std::string& name)
+{
+    const std::string shm_name = name.empty() || name[0] == '/' ? name : "/" + name;
+
+    if (shm_name == shm_name_)
+        return shm_name_.empty() || page_type_ == TTPageType::SHARED;
+
+    // The keys are hashed without a salt, so every process finds the same entries. The current entries were stored
+    // with a different salt, so aren't kept.
+    Deallocate();
+    shm_name_ = shm_name;
+    key_salt_ = 0;
+    game_ = 0;
+    Allocate();
+
+    if (!shm_name_.empty() && page_type_ != TTPageType::SHARED)
+    {
+        shm_name_.clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool TranspositionTable::AttachSharedMemory()
+{
 #ifdef __linux__
-    constexpr static size_t huge_page_size = 2 * 1024 * 1024;
     const size_t bytes = size_ * sizeof(TTBucket);
-    table = static_cast<TTBucket*>(std::aligned_alloc(huge_page_size, bytes));
-    madvise(table, bytes, MADV_HUGEPAGE);
-    std::uninitialized_default_construct_n(table, size_);
+
+    int fd = shm_open(shm_name_.c_str(), O_RDWR | O_CREAT, 0600);
+    if (fd < 0)
+        return false;
+
+    // A new segment has a size of zero, and is zero filled when extended, which is an empty table. The segment is never
+    // resized once created, because other processes would fault on the memory they had mapped.
+    struct stat stats;
+    const bool sized = fstat(fd, &stats) == 0
+        && (stats.st_size == 0 ? ftruncate(fd, bytes) == 0 : static_cast<size_t>(stats.st_size) == bytes);
+
+    void* mapping = sized ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+        return false;
+
+    table = static_cast<TTBucket*>(mapping);
+    page_type_ = TTPageType::SHARED;
+    return true;
 #else
-    table = new TTBucket[size_];
+    return false;
 #endif
 }
 
-void TranspositionTable::Deallocate()
+void TranspositionTable::Allocate()
 {
+    if (size_ == 0)
+        return;
+
+    // if the shared memory can't be attached, the table falls back to private memory
+    if (!shm_name_.empty() && AttachSharedMemory())
+        return;
+
 #ifdef __linux__
-    if (table)
+    const size_t bytes = size_ * sizeof(TTBucket);
+
+    // A thread local table is small and only used by one thread, so it gets a plain allocation that its thread first
+    // touches. Huge pages would round it up to at least 2MB, and use up the pages reserved for the global table.
+    if (usage_ == TTUsage::THREAD_LOCAL)
     {
-        std::destroy_n(table, size_);
-        std::free(table);
+        table = static_cast<TTBucket*>(std::aligned_alloc(alignof(TTBucket), bytes));
+        page_type_ = TTPageType::NORMAL;
+        Clear();
+        return;
     }
+
+    // Explicit huge pages must be reserved by the system administrator (e.g in /proc/sys/vm/nr_hugepages), and are the
+    // only way to guarantee the table is backed by large pages. Try the largest page size first.
+    struct HugePageSize
+    {
+        size_t bytes;
+        int flags;
+        TTPageType type;
+    };
+
+    // the page size is encoded as log2(bytes) in the bits above MAP_HUGE_SHIFT
+    constexpr static std::array<HugePageSize, 2> huge_page_sizes = {
+        HugePageSize { 1024 * 1024 * 1024, 30 << MAP_HUGE_SHIFT, TTPageType::HUGE_1GB },
+        HugePageSize { 2 * 1024 * 1024, 21 << MAP_HUGE_SHIFT, TTPageType::HUGE_2MB },
+    };
+
+    for (const auto& page_size : huge_page_sizes)
+    {
+        // the mapping is rounded up to a whole number of pages. That costs at most one 2MB page, but would waste up to
+        // a whole 1GB page, so the larger pages are only used when the table is close to a multiple of their size
+        if (MappedBytes(size_, page_size.bytes) - bytes > 2 * 1024 * 1024)
+            continue;
+
+        void* mapping = mmap(nullptr, MappedBytes(size_, page_size.bytes), PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | page_size.flags, -1, 0);
+
+        if (mapping != MAP_FAILED)
+        {
+            table = static_cast<TTBucket*>(mapping);
+            page_type_ = page_size.type;
+            Numa::interleave(table, bytes);
+            Clear();
+            return;
+        }
+    }
+
+    constexpr static size_t huge_page_size = 2 * 1024 * 1024;
+    table = static_cast<TTBucket*>(std::aligned_alloc(huge_page_size, MappedBytes(size_, huge_page_size)));
+    page_type_ = TransparentHugePagesEnabled() && madvise(table, bytes, MADV_HUGEPAGE) == 0 ? TTPageType::TRANSPARENT
+                                                                                            : TTPageType::NORMAL;
+    Numa::interleave(table, bytes);
+    Clear();
 #else
+    table = new TTBucket[size_];
+    page_type_ = TTPageType::NORMAL;
+#endif
+}
+
+size_t TranspositionTable::MappedBytes(size_t size, size_t page_size)
+{
+    return (size * sizeof(TTBucket) + page_size - 1) / page_size * page_size;
+}
+
+void TranspositionTable::Deallocate()
+{
     if (table)
     {
-        delete[] table;
+        Free(table, size_, page_type_);
     }
+
+    table = nullptr;
+}
+
+void TranspositionTable::Free(TTBucket* buckets, size_t size, [[maybe_unused]] TTPageType page_type)
+{
+#ifdef __linux__
+    std::destroy_n(buckets, size);
+
+    if (page_type == TTPageType::HUGE_1GB || page_type == TTPageType::HUGE_2MB)
+        munmap(buckets, MappedBytes(size, page_type == TTPageType::HUGE_1GB ? 1024 * 1024 * 1024 : 2 * 1024 * 1024));
+    else if (page_type == TTPageType::SHARED)
+        munmap(buckets, size * sizeof(TTBucket));
+    else
+        std::free(buckets);
+#else
+    delete[] buckets;
 #endif
 }
 
@@ -155,3 +660,113 @@ void TranspositionTable::PreFetch(uint64_t key) const
 {
     __builtin_prefetch(&table[HashFunction(key)]);
 }
+
+#ifdef TT_STATS
+TTStats& TTStats::operator+=(const TTStats& other)
+{
+    probes += other.probes;
+    hits += other.hits;
+    collisions += other.collisions;
+
+    for (size_t i = 0; i < replacements.size(); i++)
+        replacements[i] += other.replacements[i];
+
+    return *this;
+}
+
+TTStats& TranspositionTable::Counters() const
+{
+    return thread_stats[static_cast<size_t>(usage_)];
+}
+
+void TranspositionTable::RecordCollision() const
+{
+    Counters().collisions++;
+}
+
+void TranspositionTable::PrintStats(int half_turn_count) const
+{
+    const size_t usage = static_cast<size_t>(usage_);
+    const char* name = usage_ == TTUsage::GLOBAL ? "tt" : "local_tt";
+    TTStats total;
+
+    {
+        std::lock_guard lock(stats_mutex);
+        total = retired_stats[usage];
+        for (const auto* stats : live_stats)
+            total += (*stats)[usage];
+    }
+
+    const auto percent = [](uint64_t count, uint64_t out_of)
+    { return 100.0 * static_cast<double>(count) / static_cast<double>(std::max<uint64_t>(out_of, 1)); };
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "info string " << name << " probes " << total.probes << " hits " << total.hits << " ("
+              << percent(total.hits, total.probes) << "%) collisions " << total.collisions << "\n";
+    std::cout << "info string " << name << " replacements empty " << total.replacements[TTStats::EMPTY_SLOT]
+              << " same_key " << total.replacements[TTStats::SAME_KEY] << " aged " << total.replacements[TTStats::AGED]
+              << " shallower " << total.replacements[TTStats::SHALLOWER] << "\n";
+
+    // Scanning a large table would take a while, so only the first 1M buckets (64MB) are counted
+    constexpr std::array<int, 6> depth_limits = { 1, 4, 8, 12, 16, std::numeric_limits<int>::max() };
+    std::array<uint64_t, depth_limits.size()> by_depth = {};
+    std::array<uint64_t, HALF_MOVE_MODULO> by_age = {};
+    uint64_t empty = 0;
+    uint64_t earlier_games = 0;
+    const size_t buckets = std::min<size_t>(size_, 1024 * 1024);
+    const int8_t current_generation = Generation(half_turn_count, 0);
+
+    for (size_t i = 0; i < buckets; i++)
+    {
+        for (const auto& data : table[i].data)
+        {
+            const auto entry = TTEntry::Unpack(data.load(std::memory_order_relaxed));
+
+            if (entry.generation == 0)
+            {
+                empty++;
+                continue;
+            }
+
+            by_depth[std::distance(depth_limits.begin(),
+                std::upper_bound(depth_limits.begin(), depth_limits.end(), entry.depth))]++;
+
+            if ((entry.generation & ~GENERATION_MASK) != (current_generation & ~GENERATION_MASK))
+            {
+                earlier_games++;
+                continue;
+            }
+
+            int age = current_generation - entry.generation;
+            by_age[age >= 0 ? age : age + HALF_MOVE_MODULO]++;
+        }
+    }
+
+    const uint64_t entries = buckets * TTBucket::size;
+    std::cout << "info string " << name << " occupancy " << percent(entries - empty, entries) << "% of " << entries
+              << " entries\n";
+
+    std::cout << "info string " << name << " depth";
+    for (size_t i = 0; i < by_depth.size(); i++)
+    {
+        std::cout << " <" << (i + 1 < depth_limits.size() ? std::to_string(depth_limits[i]) : "max") << ": "
+                  << percent(by_depth[i], entries) << "%";
+    }
+    std::cout << "\n";
+
+    std::cout << "info string " << name << " age";
+    for (size_t i = 0; i < by_age.size(); i++)
+        std::cout << " " << i << ": " << percent(by_age[i], entries) << "%";
+    std::cout << " earlier_games: " << percent(earlier_games, entries) << "%" << std::endl;
+
+    std::cout << std::defaultfloat;
+}
+
+void TranspositionTable::ResetStats()
+{
+    std::lock_guard lock(stats_mutex);
+    retired_stats = {};
+    for (auto* stats : live_stats)
+        *stats = {};
+}
+#endif
@@ -2,14 +2,71 @@
 #include <cstddef>
 #include <cstdint>
 #include <memory> //required to compile with g++
+#include <optional>
+#include <ostream>
+#include <string>
 
 #include "TTEntry.h"
 
 class Move;
 
+// How the memory backing the table was allocated, from the best to the worst case for TLB misses
+enum class TTPageType
+{
+    HUGE_1GB, // explicit huge pages from the hugetlbfs pool
+    HUGE_2MB,
+    TRANSPARENT, // normal allocation with transparent huge pages requested from the kernel
+    NORMAL,
+    SHARED, // a POSIX shared memory segment, shared with other processes
+};
+
+std::ostream& operator<<(std::ostream& os, TTPageType type);
+
+#ifdef TT_STATS
+// Counters for tuning the table size, enabled with make <target> TT_STATS=true. Each thread counts into its own
+// thread_local copy, and the copies are only summed when the stats are printed.
+struct TTStats
+{
+    // why a slot was picked when storing an entry
+    enum Replacement
+    {
+        EMPTY_SLOT,
+        SAME_KEY,
+        AGED, // the replaced entry is from an earlier search or game
+        SHALLOWER, // the replaced entry is from this search, but had the lowest depth in the bucket
+        REPLACEMENT_COUNT,
+    };
+
+    uint64_t probes = 0;
+    uint64_t hits = 0;
+    uint64_t collisions = 0; // hits with a move that isn't legal, so the entry must be for a different position
+    std::array<uint64_t, REPLACEMENT_COUNT> replacements = {};
+
+    TTStats& operator+=(const TTStats& other);
+};
+#endif
+
+// What the table is used for, which decides how it is allocated
+enum class TTUsage
+{
+    GLOBAL, // the table shared by all search threads, which is large and may use huge pages
+    THREAD_LOCAL, // a small table used by one search thread, which should stay in that core's cache
+};
+
+enum class TTLoadResult
+{
+    OK,
+    FILE_ERROR, // the file couldn't be opened, or was truncated
+    INVALID_FORMAT, // the file isn't a saved table
+    INVALID_VERSION, // the table was saved by a build with a different entry format
+    SHARED_TABLE, // the table is in shared memory, so can't be replaced
+    SMALLER_TABLE, // the saved table is smaller than this one, so its entries can't be re-inserted
+};
+
 class TranspositionTable
 {
 public:
+    explicit TranspositionTable(TTUsage usage = TTUsage::GLOBAL);
     ~TranspositionTable();
 
     size_t GetSize() const
@@ -19,34 +76,116 @@ public:
 
     int GetCapacity(int halfmove) const;
 
+    TTPageType GetPageType() const
+    {
+        return page_type_;
+    }
+
+    // transparent huge pages are only a hint to the kernel, so only explicit huge pages count
+    bool UsesLargePages() const
+    {
+        return page_type_ == TTPageType::HUGE_1GB || page_type_ == TTPageType::HUGE_2MB;
+    }
+
+    // clears every entry, keeping the current allocation
     void ResetTable();
 
-    // will wipe the table and reconstruct a new empty table with a set size. units in MB!
-    void SetSize(uint64_t MB);
+    // Invalidates every entry in O(1) without touching the table. Keys are XORed with a salt that changes each new game
+    // before they are hashed, so old entries no longer match, and the generation records the game so old entries are
+    // replaced first.
+    void NewGame();
+
+    // the number of threads used to clear the table
+    void SetThreads(int threads);
+
+    // Back the table with a named POSIX shared memory segment, which other processes can attach to using the same name
+    // and size. Entries are verified without locks, so processes can read and write concurrently. The segment stays
+    // until it is removed (e.g from /dev/shm) or the system restarts, and a new game doesn't invalidate the entries
+    // because other processes may still be using them. An empty name switches back to a private table. Returns false
+    // if the segment couldn't be attached, e.g because it exists with a different size, and the table is private.
+    bool SetSharedMemory(const std::string& name);
+
+    // Resize the table, in MB. When shrinking, the entries from the current game are re-inserted into the new table in
+    // parallel, so both tables are allocated at the same time. Growing the table empties it, because the entries don't
+    // keep enough bits of their key to find their place in a larger table. With require_large_pages, a new table that
+    // doesn't get large pages is freed and the old table is kept unchanged, returning false.
+    bool SetSize(uint64_t MB, bool require_large_pages = false);
+
+    // as above, but in KB for small tables. A size of zero frees the table, and it must not be used until resized.
+    bool SetSizeKB(uint64_t KB, bool require_large_pages = false);
+
+    // allocate a new empty table of the same size, e.g after the NUMA policy changes
+    void Reallocate();
+
+    // Write the table to a file with a small header, returning false if the file couldn't be written
+    bool Save(const std::string& path) const;
+
+    // Replace the contents of the table with a table written by Save. A table of the same size is read directly into
+    // memory, and a larger table has its entries re-inserted. The current size is kept either way, so a smaller table
+    // can't be loaded.
+    TTLoadResult Load(const std::string& path);
 
-    void AddEntry(const Move& best, uint64_t ZobristKey, Score Score, int Depth, int Turncount, int distanceFromRoot,
-        SearchResultType Cutoff);
+    void AddEntry(const Move& best, uint64_t ZobristKey, Score score, Score static_eval, int Depth, int Turncount,
+        int distanceFromRoot, SearchResultType Cutoff);
 
     void PreFetch(uint64_t key) const;
 
+#ifdef TT_STATS
+    // record a hit that turned out to be for a different position
+    void RecordCollision() const;
+
+    // Print the counters summed over all threads, and the occupancy of the table by depth and age. The counters are
+    // kept separately for each usage, so the thread local tables print the counters of all thread local tables. Must
+    // not be called while searching.
+    void PrintStats(int half_turn_count) const;
+    static void ResetStats();
+#endif
+
     // find a matching entry at any depth
-    TTEntry* GetEntry(uint64_t key, int distanceFromRoot, int half_turn_count);
+    std::optional<TTEntry> GetEntry(uint64_t key, int distanceFromRoot, int half_turn_count);
 
 private:
     uint64_t HashFunction(const uint64_t& key) const;
-    void Reallocate();
+    uint16_t KeyCheck(const uint64_t& key) const;
+    void Allocate();
+    bool AttachSharedMemory();
     void Deallocate();
+    static void Free(TTBucket* buckets, size_t size, TTPageType page_type);
+
+    // the size of a table rounded up to a whole number of pages
+    static size_t MappedBytes(size_t size, size_t page_size);
+
+    // write an entry into a bucket, using the replacement scheme if the bucket is full
+    void Store(TTBucket& bucket, uint16_t key_check, const TTEntry& entry);
 
-    static constexpr uint64_t CalculateEntryCount(uint64_t MB)
+    // Insert the entries of the current game from buckets [first, first + count) of an old table with old_size buckets
+    // into this table, which must not be larger. buckets points to bucket first of the old table.
+    void Reinsert(const TTBucket* buckets, size_t first, size_t count, size_t old_size);
+
+    // construct every bucket, split across threads_ threads. This also means each page is first touched by one of the
+    // threads, rather than all by the same thread.
+    void Clear();
+
+    // the generation of entries written in the current game
+    int8_t Generation(int half_turn_count, int distance_from_root) const;
+
+    static constexpr uint64_t CalculateEntryCount(uint64_t KB)
     {
-        return MB * 1024 * 1024 / sizeof(TTBucket);
+        return KB * 1024 / sizeof(TTBucket);
     }
 
     // raw array and memset allocates quicker than std::vector
-    TTBucket* table;
-    size_t size_;
-    uint64_t hash_mask_;
-};
+    TTBucket* table = nullptr;
+    size_t size_ = 0;
+    TTPageType page_type_ = TTPageType::NORMAL;
+    int threads_ = 1;
+    uint64_t key_salt_ = 0;
+    int game_ = 0;
+    std::string shm_name_;
+    const TTUsage usage_;
 
-bool CheckEntry(const TTEntry& entry, uint64_t key, int depth);
-bool CheckEntry(const TTEntry& entry, uint64_t key);
+#ifdef TT_STATS
+    // the calling thread's counters for this table's usage
+    TTStats& Counters() const;
+#endif
+};
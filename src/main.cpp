@@ -1,7 +1,6 @@
 #include <iostream>
 #include <string>
 
-#include "Network.h"
 #include "uci/uci.h"
 
 constexpr std::string_view version = "11.23.0";
@@ -30,13 +29,20 @@ void PrintVersion()
     std::cout << " PEXT";
 #endif
 
+#if defined(USE_INT8_L1)
+    std::cout << " INT8_L1";
+#endif
+
+#if defined(TT_STATS)
+    std::cout << " TT_STATS";
+#endif
+
     std::cout << std::endl;
 }
 
 int main(int argc, char* argv[])
 {
     std::ios::sync_with_stdio(false);
-    Network::Init();
     Uci uci { version };
 
     PrintVersion();
@@ -4,6 +4,8 @@
 #include "../EGTB.h"
 #include "../GameState.h"
 #include "../MoveGeneration.h"
+#include "../Network.h"
+#include "../Numa.h"
 #include "../SearchConstants.h"
 #include "../SearchData.h"
 #include "options.h"
@@ -141,6 +143,10 @@ void Uci::handle_bench(int depth)
 {
     Timer timer;
 
+#ifdef TT_STATS
+    TranspositionTable::ResetStats();
+#endif
+
     uint64_t nodeCount = 0;
     shared.limits.depth = depth;
 
@@ -157,10 +163,119 @@ void Uci::handle_bench(int depth)
         nodeCount += shared.nodes();
     }
 
+#ifdef TT_STATS
+    print_tt_stats();
+#endif
+
     int elapsed_time = std::chrono::duration_cast<std::chrono::milliseconds>(timer.elapsed()).count();
     std::cout << nodeCount << " nodes " << nodeCount / std::max(elapsed_time, 1) * 1000 << " nps" << std::endl;
 }
 
+void Uci::handle_ttstats()
+{
+#ifdef TT_STATS
+    print_tt_stats();
+#else
+    std::cout << "info string transposition table stats are disabled, build with TT_STATS=true" << std::endl;
+#endif
+}
+
+#ifdef TT_STATS
+void Uci::print_tt_stats()
+{
+    tTable.PrintStats(position.Board().half_turn_count);
+
+    // the counters are summed over every thread's table, but the occupancy only scans the first thread's table
+    if (const auto& local_tt = shared.get_local_state(0).local_tt; local_tt.GetSize() > 0)
+        local_tt.PrintStats(position.Board().half_turn_count);
+}
+#endif
+
+void Uci::handle_evalbatch(std::string_view path)
+{
+    // Read the file in chunks, so arbitrarily large files can be scored without holding every position in memory
+    constexpr size_t CHUNK_SIZE = 4096;
+
+    std::ifstream file { std::string(path) };
+    if (!file)
+    {
+        std::cout << "info string unable to open file " << path << std::endl;
+        return;
+    }
+
+    Timer timer;
+    size_t count = 0;
+    std::vector<std::string> fens;
+    std::vector<BoardState> boards;
+    std::string line;
+
+    while (file)
+    {
+        fens.clear();
+        boards.clear();
+
+        while (fens.size() < CHUNK_SIZE && std::getline(file, line))
+        {
+            BoardState board;
+            if (!board.InitialiseFromFen(line))
+            {
+                std::cout << "info string bad fen " << std::quoted(line) << std::endl;
+                continue;
+            }
+
+            fens.push_back(line);
+            boards.push_back(board);
+        }
+
+        auto scores = Network::EvalBatch(boards);
+
+        for (size_t i = 0; i < scores.size(); i++)
+            std::cout << fens[i] << " eval " << scores[i].value() << "\n";
+
+        count += scores.size();
+    }
+
+    int elapsed_time = std::chrono::duration_cast<std::chrono::milliseconds>(timer.elapsed()).count();
+    std::cout << count << " positions " << count / std::max(elapsed_time, 1) * 1000 << " pps" << std::endl;
+}
+
+void Uci::handle_save_hash(std::string_view path)
+{
+    if (!tTable.Save(std::string(path)))
+    {
+        std::cout << "info string unable to write file " << path << std::endl;
+        return;
+    }
+
+    std::cout << "info string saved transposition table to " << path << std::endl;
+}
+
+void Uci::handle_load_hash(std::string_view path)
+{
+    switch (tTable.Load(std::string(path)))
+    {
+    case TTLoadResult::OK:
+        std::cout << "info string loaded transposition table from " << path << std::endl;
+        return;
+    case TTLoadResult::FILE_ERROR:
+        std::cout << "info string unable to read file " << path << std::endl;
+        return;
+    case TTLoadResult::INVALID_FORMAT:
+        std::cout << "info string " << path << " is not a saved transposition table" << std::endl;
+        return;
+    case TTLoadResult::INVALID_VERSION:
+        std::cout << "info string " << path << " was saved by an incompatible version" << std::endl;
+        return;
+    case TTLoadResult::SHARED_TABLE:
+        std::cout << "info string unable to load into a shared transposition table" << std::endl;
+        return;
+    case TTLoadResult::SMALLER_TABLE:
+        std::cout << "info string " << path << " holds a smaller transposition table, set Hash to at most its size"
+                  << std::endl;
+        return;
+    }
+}
+
 auto Uci::options_handler()
 {
 #define tuneable_int(name, default_, min_, max_)                                                                       \
@@ -176,12 +291,20 @@ auto Uci::options_handler()
     }
 
     return uci_options {
+        string_option { "NUMA", "off", [this](auto value) { return handle_setoption_numa(value); } },
         button_option { "Clear Hash", [this] { handle_setoption_clear_hash(); } },
         check_option { "UCI_Chess960", false, [this](bool value) { handle_setoption_chess960(value); } },
         spin_option { "Hash", 32, 1, 262144, [this](auto value) { return handle_setoption_hash(value); } },
+        check_option { "RequireLargePages", false,
+            [this](bool value) { return handle_setoption_require_large_pages(value); } },
+        string_option { "SharedHash", "<empty>", [this](auto value) { return handle_setoption_shared_hash(value); } },
         spin_option { "Threads", 1, 1, 256, [this](auto value) { handle_setoption_threads(value); } },
+        spin_option { "EvalCache", 1, 1, 1024, [this](auto value) { handle_setoption_eval_cache(value); } },
+        check_option { "SharedEvalCache", false, [this](bool value) { handle_setoption_shared_eval_cache(value); } },
+        spin_option { "LocalHash", 0, 0, 65536, [this](auto value) { handle_setoption_local_hash(value); } },
         spin_option { "MultiPV", 1, 1, 256, [this](auto value) { handle_setoption_multipv(value); } },
         string_option { "SyzygyPath", "<empty>", [this](auto value) { handle_setoption_syzygy_path(value); } },
+        string_option { "EvalFile", "<internal>", [this](auto value) { return handle_setoption_eval_file(value); } },
     };
 
 #undef tuneable_int
@@ -215,7 +338,7 @@ void Uci::handle_isready()
 void Uci::handle_ucinewgame()
 {
     position.StartingPosition();
-    tTable.ResetTable();
+    tTable.NewGame();
     shared.ResetNewGame();
 }
 
@@ -283,19 +406,88 @@ void Uci::handle_setoption_clear_hash()
 
 bool Uci::handle_setoption_hash(int value)
 {
-    if (GetBitCount(value) != 1)
+    // other processes have the segment mapped at its current size, so it can't be resized
+    if (tTable.GetPageType() == TTPageType::SHARED)
+    {
+        std::cout << "info string error Hash can't be changed while SharedHash is set" << std::endl;
+        return false;
+    }
+
+    // the table is left as it was if the new size can't get large pages
+    const auto old_page_type = tTable.GetPageType();
+    if (!tTable.SetSize(value, require_large_pages_))
     {
-        std::cout << "info error transposition table size must be a power of two" << std::endl;
+        std::cout << "info string error large pages are required but unavailable at Hash " << value << std::endl;
         return false;
     }
 
-    tTable.SetSize(value);
+    // the default size is applied at startup, which isn't worth reporting
+    if (hash_size_mb_ != 0 && tTable.GetPageType() != old_page_type)
+        std::cout << "info string transposition table using " << tTable.GetPageType() << std::endl;
+
+    if (hash_size_mb_ != 0 && value > hash_size_mb_)
+        std::cout << "info string transposition table emptied, entries are only kept when Hash shrinks" << std::endl;
+
+    hash_size_mb_ = value;
+    return true;
+}
+
+bool Uci::handle_setoption_require_large_pages(bool value)
+{
+    if (value && !tTable.UsesLargePages())
+    {
+        std::cout << "info string error large pages are required but the transposition table is using "
+                  << tTable.GetPageType() << std::endl;
+        return false;
+    }
+
+    require_large_pages_ = value;
+    return true;
+}
+
+bool Uci::handle_setoption_shared_hash(std::string_view value)
+{
+    const auto name = value == "<empty>" ? std::string() : std::string(value);
+
+    // shared memory never uses explicit huge pages
+    if (require_large_pages_ && !name.empty())
+    {
+        std::cout << "info string error SharedHash can't be used while RequireLargePages is set" << std::endl;
+        return false;
+    }
+
+    if (!tTable.SetSharedMemory(name))
+    {
+        std::cout << "info string error unable to attach shared memory " << value
+                  << ", all processes must use the same Hash size" << std::endl;
+        return false;
+    }
+
+    if (!name.empty())
+        std::cout << "info string transposition table using " << tTable.GetPageType() << " " << name << std::endl;
+
     return true;
 }
 
 void Uci::handle_setoption_threads(int value)
 {
     shared.set_threads(value);
+    tTable.SetThreads(value);
+}
+
+void Uci::handle_setoption_eval_cache(int value)
+{
+    shared.set_eval_cache_size(value);
+}
+
+void Uci::handle_setoption_local_hash(int value)
+{
+    shared.set_local_tt_size(value);
+}
+
+void Uci::handle_setoption_shared_eval_cache(bool value)
+{
+    shared.set_shared_eval_cache(value);
 }
 
 void Uci::handle_setoption_syzygy_path(std::string_view value)
@@ -313,6 +505,48 @@ void Uci::handle_setoption_chess960(bool value)
     shared.chess_960 = value;
 }
 
+bool Uci::handle_setoption_eval_file(std::string_view value)
+{
+    if (value == "<internal>")
+    {
+        Network::Init();
+    }
+    else if (!Network::LoadFile(std::string(value)))
+    {
+        return false;
+    }
+
+    // Cached evaluations, and the static evals stored in the transposition table, came from the previous network. A
+    // shared table is left alone, because clearing it would wipe it for every attached process.
+    shared.reset_cached_evals();
+    if (tTable.GetPageType() != TTPageType::SHARED)
+        tTable.ResetTable();
+    position.RecalculateNetwork();
+    return true;
+}
+
+bool Uci::handle_setoption_numa(std::string_view value)
+{
+    if (!Numa::configure(value))
+    {
+        std::cout << "info string invalid NUMA setting " << value << std::endl;
+        return false;
+    }
+
+    if (Numa::enabled())
+        std::cout << "info string NUMA placement using " << Numa::node_count() << " nodes" << std::endl;
+
+    // Reallocate the memory that depends on the placement. Before the other options have their defaults set, there is
+    // nothing to reallocate.
+    if (shared.get_threads_setting() > 0)
+    {
+        tTable.Reallocate();
+        shared.set_threads(shared.get_threads_setting());
+    }
+
+    return true;
+}
+
 void Uci::handle_stop()
 {
     KeepSearching = false;
@@ -398,6 +632,10 @@ void Uci::process_input(std::string_view command)
         consume { "bench", one_of  {
             sequence { end_command{}, invoke { [this]{ handle_bench(10); } } },
             next_token { to_int { [this](auto value){ handle_bench(value); } } } } },
+        consume { "ttstats", invoke { [this] { handle_ttstats(); } } },
+        consume { "evalbatch", next_token { [this](auto value){ handle_evalbatch(value); } } },
+        consume { "save_hash", next_token { [this](auto value){ handle_save_hash(value); } } },
+        consume { "load_hash", next_token { [this](auto value){ handle_load_hash(value); } } },
         consume { "print", invoke { [this] { std::cout << position.Board(); } } },
         consume { "spsa", invoke { [this] { handle_spsa(); } } } },
     end_command{}
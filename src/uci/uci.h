@@ -36,21 +36,39 @@ private:
     void handle_go(go_ctx& ctx);
     void handle_setoption_clear_hash();
     bool handle_setoption_hash(int value);
+    bool handle_setoption_require_large_pages(bool value);
+    bool handle_setoption_shared_hash(std::string_view value);
     void handle_setoption_threads(int value);
+    void handle_setoption_eval_cache(int value);
+    void handle_setoption_shared_eval_cache(bool value);
+    void handle_setoption_local_hash(int value);
     void handle_setoption_syzygy_path(std::string_view value);
     void handle_setoption_multipv(int value);
     void handle_setoption_chess960(bool value);
+    bool handle_setoption_eval_file(std::string_view value);
+    bool handle_setoption_numa(std::string_view value);
     void handle_stop();
     void handle_quit();
     void handle_bench(int depth);
+    void handle_ttstats();
+    void handle_evalbatch(std::string_view path);
+    void handle_save_hash(std::string_view path);
+    void handle_load_hash(std::string_view path);
     void handle_spsa();
 
     void join_search_thread();
 
+#ifdef TT_STATS
+    // print the stats of the shared table, and of the thread local tables if they are enabled
+    void print_tt_stats();
+#endif
+
     GameState position;
     std::thread searchThread;
     SearchSharedState shared { *this };
     const std::string_view version_;
+    bool require_large_pages_ = false;
+    int hash_size_mb_ = 0; // the last Hash size that was accepted
 
     auto options_handler();
 };